@@ -8,6 +8,8 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include "db/dbformat.h"
+#include "db/memtable.h"
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
@@ -15,6 +17,7 @@
 #include "leveldb/filter_policy.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -39,6 +42,8 @@
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      mergeK        -- scan N entries spread over K in-memory children through
+//                       a merging iterator, e.g. merge4, merge16, merge64
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -90,6 +95,18 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Number of write buffers that may be held in memory at once.
+// Negative means use default settings.
+static int FLAGS_max_write_buffer_number = -1;
+
+// Number of compactions that may run at once; also sizes the Env's
+// low-priority thread pool.  Negative means use default settings.
+static int FLAGS_max_background_compactions = -1;
+
+// Number of threads that may work on one compaction.
+// Negative means use default settings.
+static int FLAGS_max_subcompactions = -1;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
@@ -120,9 +137,18 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap log appends and memtable inserts of successive writes.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, writers in a group insert into the memtable in parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
 // If true, use compression.
 static bool FLAGS_compression = true;
 
+// If true, memory-map every table file.
+static bool FLAGS_mmap_reads = false;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -435,6 +461,7 @@ class Benchmark {
   int entries_per_batch_;
   WriteOptions write_options_;
   int reads_;
+  int merge_fan_in_;
   int heap_counter_;
   CountComparator count_comparator_;
   int total_thread_count_;
@@ -528,6 +555,7 @@ class Benchmark {
         value_size_(FLAGS_value_size),
         entries_per_batch_(1),
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
+        merge_fan_in_(0),
         heap_counter_(0),
         count_comparator_(BytewiseComparator()),
         total_thread_count_(0) {
@@ -639,6 +667,11 @@ class Benchmark {
         method = &Benchmark::ZstdCompress;
       } else if (name == Slice("zstduncomp")) {
         method = &Benchmark::ZstdUncompress;
+      } else if (name.starts_with("merge") &&
+                 std::sscanf(name.ToString().c_str(), "merge%d",
+                             &merge_fan_in_) == 1 &&
+                 merge_fan_in_ > 0) {
+        method = &Benchmark::Merge;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
@@ -772,6 +805,47 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  void Merge(ThreadState* thread) {
+    // Spread num_ keys randomly over merge_fan_in_ memtables, then time full
+    // forward scans over all of them through a merging iterator.
+    InternalKeyComparator icmp(BytewiseComparator());
+    std::vector<MemTable*> mems;
+    for (int i = 0; i < merge_fan_in_; i++) {
+      mems.push_back(new MemTable(icmp));
+      mems.back()->Ref();
+    }
+    RandomGenerator gen;
+    Random rand(301 + thread->tid);
+    KeyBuffer key;
+    for (int i = 0; i < num_; i++) {
+      key.Set(i);
+      mems[rand.Uniform(merge_fan_in_)]->Add(i + 1, kTypeValue, key.slice(),
+                                             gen.Generate(value_size_));
+    }
+
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(fan-in %d)", merge_fan_in_);
+    std::vector<Iterator*> children(merge_fan_in_);
+    int64_t bytes = 0;
+    for (int pass = 0; pass < 10; pass++) {
+      for (int i = 0; i < merge_fan_in_; i++) {
+        children[i] = mems[i]->NewIterator();
+      }
+      Iterator* iter =
+          NewMergingIterator(&icmp, children.data(), merge_fan_in_);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        bytes += iter->key().size() + iter->value().size();
+        thread->stats.FinishedSingleOp();
+      }
+      delete iter;
+    }
+    for (MemTable* mem : mems) {
+      mem->Unref();
+    }
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     Compress(thread, "snappy", &port::Snappy_Compress);
   }
@@ -806,6 +880,17 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    if (FLAGS_max_write_buffer_number >= 0) {
+      options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    }
+    if (FLAGS_max_background_compactions >= 0) {
+      options.max_background_compactions = FLAGS_max_background_compactions;
+      g_env->SetBackgroundThreads(FLAGS_max_background_compactions,
+                                  leveldb::Env::kLow);
+    }
+    if (FLAGS_max_subcompactions >= 0) {
+      options.max_subcompactions = FLAGS_max_subcompactions;
+    }
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     if (FLAGS_comparisons) {
@@ -814,8 +899,12 @@ class Benchmark {
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
+    options.use_mmap_reads = FLAGS_mmap_reads;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -1090,9 +1179,20 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--mmap_reads=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_mmap_reads = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1103,6 +1203,14 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_write_buffer_number = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
@@ -15,21 +15,37 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    s = options.use_direct_io_for_flush_and_compaction
+            ? env->NewDirectWritableFile(fname, &file)
+            : env->NewWritableFile(fname, &file);
+    if (options.use_direct_io_for_flush_and_compaction &&
+        s.IsNotSupportedError()) {
+      s = Status::NotSupported(fname, "use_direct_io_for_flush_and_compaction");
+    }
     if (!s.ok()) {
       return s;
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    const InternalKeyComparator* icmp =
+        static_cast<const InternalKeyComparator*>(options.comparator);
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     Slice key;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
@@ -38,10 +54,47 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
+    bool has_keys = !key.empty();
 
-    // Finish and check for builder errors
-    s = builder->Finish();
+    // A tombstone [begin, end) spans from its own start key to just
+    // before every entry for "end".
+    for (; range_del_iter != nullptr && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      ParsedInternalKey start;
+      if (!ParseInternalKey(range_del_iter->key(), &start)) {
+        s = Status::Corruption("bad range tombstone");
+        break;
+      }
+      if (icmp->user_comparator()->Compare(start.user_key,
+                                           range_del_iter->value()) >= 0) {
+        continue;  // Empty range
+      }
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      meta->has_range_deletions = true;
+      InternalKey smallest, largest;
+      smallest.DecodeFrom(range_del_iter->key());
+      largest = InternalKey(range_del_iter->value(), kMaxSequenceNumber,
+                            kTypeRangeDeletion);
+      if (!has_keys || icmp->Compare(smallest, meta->smallest) < 0) {
+        meta->smallest = smallest;
+      }
+      if (!has_keys || icmp->Compare(largest, meta->largest) > 0) {
+        meta->largest = largest;
+      }
+      has_keys = true;
+    }
     if (s.ok()) {
+      s = builder->status();
+    }
+
+    // Finish and check for builder errors
+    if (s.ok() && has_keys) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
+    if (s.ok() && has_keys) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
     }
@@ -57,10 +110,10 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     delete file;
     file = nullptr;
 
-    if (s.ok()) {
+    if (s.ok() && meta->file_size > 0) {
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, 0);
       s = it->status();
       delete it;
     }
@@ -70,6 +123,9 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
   if (s.ok() && meta->file_size > 0) {
     // Keep it
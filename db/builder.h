@@ -22,8 +22,13 @@ class VersionEdit;
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
+//
+// If range_del_iter is non-null, the range tombstones it yields (keyed
+// by the internal key of their start key, with the end key as value)
+// are stored in the table as well, and widen the key range in *meta.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta);
 
 }  // namespace leveldb
 
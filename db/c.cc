@@ -193,6 +193,15 @@ void leveldb_delete(leveldb_t* db, const leveldb_writeoptions_t* options,
   SaveError(errptr, db->rep->Delete(options->rep, Slice(key, keylen)));
 }
 
+void leveldb_delete_range(leveldb_t* db, const leveldb_writeoptions_t* options,
+                          const char* begin_key, size_t begin_keylen,
+                          const char* end_key, size_t end_keylen,
+                          char** errptr) {
+  SaveError(errptr,
+            db->rep->DeleteRange(options->rep, Slice(begin_key, begin_keylen),
+                                 Slice(end_key, end_keylen)));
+}
+
 void leveldb_write(leveldb_t* db, const leveldb_writeoptions_t* options,
                    leveldb_writebatch_t* batch, char** errptr) {
   SaveError(errptr, db->rep->Write(options->rep, &batch->rep));
@@ -270,6 +279,18 @@ void leveldb_compact_range(leveldb_t* db, const char* start_key,
       (limit_key ? (b = Slice(limit_key, limit_key_len), &b) : nullptr));
 }
 
+void leveldb_delete_files_in_range(leveldb_t* db, const char* start_key,
+                                   size_t start_key_len, const char* limit_key,
+                                   size_t limit_key_len, char** errptr) {
+  Slice a, b;
+  SaveError(errptr,
+            db->rep->DeleteFilesInRange(
+                (start_key ? (a = Slice(start_key, start_key_len), &a)
+                           : nullptr),
+                (limit_key ? (b = Slice(limit_key, limit_key_len), &b)
+                           : nullptr)));
+}
+
 void leveldb_destroy_db(const leveldb_options_t* options, const char* name,
                         char** errptr) {
   SaveError(errptr, DestroyDB(name, options->rep));
@@ -339,27 +360,52 @@ void leveldb_writebatch_delete(leveldb_writebatch_t* b, const char* key,
   b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_delete_range(leveldb_writebatch_t* b,
+                                     const char* begin_key, size_t begin_klen,
+                                     const char* end_key, size_t end_klen) {
+  b->rep.DeleteRange(Slice(begin_key, begin_klen), Slice(end_key, end_klen));
+}
+
 void leveldb_writebatch_iterate(const leveldb_writebatch_t* b, void* state,
                                 void (*put)(void*, const char* k, size_t klen,
                                             const char* v, size_t vlen),
                                 void (*deleted)(void*, const char* k,
                                                 size_t klen)) {
+  leveldb_writebatch_iterate_ranges(b, state, put, deleted, nullptr);
+}
+
+void leveldb_writebatch_iterate_ranges(
+    const leveldb_writebatch_t* b, void* state,
+    void (*put)(void*, const char* k, size_t klen, const char* v,
+                size_t vlen),
+    void (*deleted)(void*, const char* k, size_t klen),
+    void (*deleted_range)(void*, const char* begin_key, size_t begin_klen,
+                          const char* end_key, size_t end_klen)) {
   class H : public WriteBatch::Handler {
    public:
     void* state_;
     void (*put_)(void*, const char* k, size_t klen, const char* v, size_t vlen);
     void (*deleted_)(void*, const char* k, size_t klen);
+    void (*deleted_range_)(void*, const char* begin_key, size_t begin_klen,
+                           const char* end_key, size_t end_klen);
     void Put(const Slice& key, const Slice& value) override {
       (*put_)(state_, key.data(), key.size(), value.data(), value.size());
     }
     void Delete(const Slice& key) override {
       (*deleted_)(state_, key.data(), key.size());
     }
+    void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+      if (deleted_range_ != nullptr) {
+        (*deleted_range_)(state_, begin_key.data(), begin_key.size(),
+                          end_key.data(), end_key.size());
+      }
+    }
   };
   H handler;
   handler.state_ = state;
   handler.put_ = put;
   handler.deleted_ = deleted;
+  handler.deleted_range_ = deleted_range;
   b->rep.Iterate(&handler);
 }
 
@@ -102,6 +102,16 @@ static void CheckDel(void* ptr, const char* k, size_t klen) {
   (*state)++;
 }
 
+// Callback from leveldb_writebatch_iterate_ranges()
+static void CheckDelRange(void* ptr, const char* b, size_t blen,
+                          const char* e, size_t elen) {
+  int* state = (int*) ptr;
+  CheckCondition(*state == 3);
+  CheckEqual("c", b, blen);
+  CheckEqual("d", e, elen);
+  (*state)++;
+}
+
 static void CmpDestroy(void* arg) { }
 
 static int CmpCompare(void* arg, const char* a, size_t alen,
@@ -241,6 +251,15 @@ int main(int argc, char** argv) {
     int pos = 0;
     leveldb_writebatch_iterate(wb, &pos, CheckPut, CheckDel);
     CheckCondition(pos == 3);
+
+    leveldb_writebatch_delete_range(wb, "c", 1, "d", 1);
+    pos = 0;
+    leveldb_writebatch_iterate(wb, &pos, CheckPut, CheckDel);
+    CheckCondition(pos == 3);
+    pos = 0;
+    leveldb_writebatch_iterate_ranges(wb, &pos, CheckPut, CheckDel,
+                                      CheckDelRange);
+    CheckCondition(pos == 4);
     leveldb_writebatch_destroy(wb);
   }
 
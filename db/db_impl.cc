@@ -19,6 +19,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -42,13 +43,28 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        cv(mu),
+        leader(nullptr),
+        insert_mem(nullptr),
+        insert_slot(0),
+        pending_inserts(0) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
   port::CondVar cv;
+
+  // State for allow_concurrent_memtable_write.  A leader sets insert_mem
+  // to hand a follower its own memtable insert, and counts the inserts it
+  // is still waiting for in its own pending_inserts.
+  Writer* leader;
+  MemTable* insert_mem;
+  int insert_slot;
+  int pending_inserts;
 };
 
 struct DBImpl::CompactionState {
@@ -57,6 +73,7 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -64,6 +81,8 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        range_dels(nullptr),
+        output_tombstones(nullptr),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -76,6 +95,13 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Range tombstones of the inputs.  Entries they delete at a sequence
+  // number <= smallest_snapshot are dropped.  Null if there are none.
+  const RangeTombstoneList* range_dels;
+
+  // The range tombstones that must be kept in the outputs.
+  const std::vector<RangeTombstone>* output_tombstones;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -94,12 +120,18 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
   if (result.info_log == nullptr) {
@@ -113,11 +145,66 @@ Options SanitizeOptions(const std::string& dbname,
     }
   }
   if (result.block_cache == nullptr) {
-    result.block_cache = NewLRUCache(8 << 20);
+    result.block_cache = NewLRUCache(8 << 20, 0.5);
   }
   return result;
 }
 
+// The memtables and version a read needs, pinned together.  The DB holds
+// one reference to the installed SuperVersion and every thread that has
+// read since it was installed holds another through its cached copy, so
+// reads only touch the atomic reference count.
+struct SuperVersion {
+  MemTable* mem;
+  std::vector<MemTable*> imms;  // Newest first
+  Version* current;
+  std::atomic<int> refs;
+
+  SuperVersion() : mem(nullptr), current(nullptr), refs(0) {}
+
+  void Ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+  // Drop a reference.  Returns true if it was the last one, in which case
+  // the caller must call Cleanup() while holding the DB mutex.
+  bool Unref() {
+    int old_refs = refs.fetch_sub(1, std::memory_order_acq_rel);
+    assert(old_refs > 0);
+    return old_refs == 1;
+  }
+
+  // Unref the memtables and version and delete this.
+  // REQUIRES: the DB mutex is held.
+  void Cleanup() {
+    mem->Unref();
+    for (MemTable* imm : imms) {
+      imm->Unref();
+    }
+    current->Unref();
+    delete this;
+  }
+};
+
+namespace {
+
+// Stored in a thread's SuperVersion slot while a read is using the
+// SuperVersion taken from it, so that InstallSuperVersion() can tell the
+// read apart from a cached reference.
+char super_version_in_use;
+void* const kSuperVersionInUse = &super_version_in_use;
+
+// Drops a thread's cached SuperVersion when the thread exits.  A cached
+// copy is always the installed SuperVersion, which the DB still
+// references, so this is never the last reference.
+void ReleaseCachedSuperVersion(void* ptr) {
+  if (ptr != kSuperVersionInUse) {
+    bool last = static_cast<SuperVersion*>(ptr)->Unref();
+    assert(!last);
+    (void)last;
+  }
+}
+
+}  // namespace
+
 static int TableCacheSize(const Options& sanitized_options) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   return sanitized_options.max_open_files - kNumNonTableCacheFiles;
@@ -127,8 +214,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -137,23 +226,29 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      last_allocated_sequence_(0),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
+      imm_flush_in_progress_(false),
+      manifest_write_in_progress_(false),
+      manifest_write_finished_signal_(&mutex_),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      super_version_(nullptr),
+      local_super_version_(&ReleaseCachedSuperVersion) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -162,9 +257,25 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
+  if (super_version_ != nullptr) {
+    // No reads are running, so the slots only hold cached references.
+    std::vector<void*> cached;
+    local_super_version_.Scrape(&cached, nullptr);
+    mutex_.Lock();
+    for (void* ptr : cached) {
+      static_cast<SuperVersion*>(ptr)->Unref();
+    }
+    if (super_version_->Unref()) {
+      super_version_->Cleanup();
+    }
+    mutex_.Unlock();
+  }
+
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (const ImmutableMemTable& imm : imm_) {
+    imm.mem->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -455,7 +566,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, false, &number);
+      pending_outputs_.erase(number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -494,7 +607,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, false, &number);
+      pending_outputs_.erase(number);
     }
     mem->Unref();
   }
@@ -503,20 +618,23 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                bool pick_level, uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
+  *number = meta.number;
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                   range_del_iter, &meta);
     mutex_.Lock();
   }
 
@@ -524,7 +642,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -532,11 +650,24 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
-      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+    if (pick_level) {
+      // Compactions may have changed the version while the table was
+      // being built.  Choose the level against the version that *edit
+      // will be applied to; the caller applies it without releasing
+      // mutex_ in between.
+      while (manifest_write_in_progress_) {
+        manifest_write_finished_signal_.Wait();
+      }
+      level = versions_->current()->PickLevelForMemTableOutput(min_user_key,
+                                                               max_user_key);
+      if (level > 0 && versions_->RangeBeingCompactedInto(
+                           level, min_user_key, max_user_key)) {
+        // A running compaction may add overlapping files to that level.
+        level = 0;
+      }
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_deletions);
   }
 
   CompactionStats stats;
@@ -548,14 +679,15 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
+  assert(!imm_.empty());
+  assert(!imm_flush_in_progress_);
+  imm_flush_in_progress_ = true;
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of the oldest memtable as a new Table
+  const ImmutableMemTable imm = imm_.front();
   VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  uint64_t number;
+  Status s = WriteLevel0Table(imm.mem, &edit, true, &number);
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
@@ -564,19 +696,39 @@ void DBImpl::CompactMemTable() {
   // Replace immutable memtable with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    edit.SetLogNumber(imm.next_log_number);  // Earlier logs no longer needed
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(number);
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    assert(imm_.front().mem == imm.mem);
+    imm.mem->Unref();
+    imm_.pop_front();
+    has_imm_.store(!imm_.empty(), std::memory_order_release);
+    InstallSuperVersion();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
+  imm_flush_in_progress_ = false;
+  MaybeScheduleFlush();
+}
+
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_write_in_progress_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  if (s.ok()) {
+    InstallSuperVersion();
+  }
+  manifest_write_in_progress_ = false;
+  manifest_write_finished_signal_.SignalAll();
+  return s;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -596,6 +748,226 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  MutexLock l(&mutex_);
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+
+  // Pick the files against the version that the edit will be applied to;
+  // LogAndApply() below does not release mutex_ before applying it.
+  while (manifest_write_in_progress_) {
+    manifest_write_finished_signal_.Wait();
+  }
+  std::vector<std::pair<int, FileMetaData*>> files;
+  versions_->current()->GetDeletableFilesInRange(begin, end, &files);
+  if (files.empty()) {
+    return Status::OK();
+  }
+
+  VersionEdit edit;
+  uint64_t bytes = 0;
+  for (const auto& level_and_file : files) {
+    edit.RemoveFile(level_and_file.first, level_and_file.second->number);
+    bytes += level_and_file.second->file_size;
+  }
+  Status s = LogAndApply(&edit);
+  Log(options_.info_log, "Deleted %d files in range (%lld bytes): %s",
+      static_cast<int>(files.size()), static_cast<long long>(bytes),
+      s.ToString().c_str());
+  if (s.ok()) {
+    RemoveObsoleteFiles();
+  } else {
+    RecordBackgroundError(s);
+  }
+  return s;
+}
+
+// Returns true iff "mem" holds an entry or a range tombstone that
+// overlaps the user key range [smallest_user_key,largest_user_key].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest_user_key,
+                             const Slice& largest_user_key) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  bool overlaps = iter->Valid() && ucmp->Compare(ExtractUserKey(iter->key()),
+                                                 largest_user_key) <= 0;
+  delete iter;
+
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); !overlaps && iter->Valid(); iter->Next()) {
+      overlaps =
+          ucmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0 &&
+          ucmp->Compare(iter->value(), smallest_user_key) > 0;
+    }
+    delete iter;
+  }
+  return overlaps;
+}
+
+Status DBImpl::IngestExternalFile(const std::string& fname) {
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Move the file into the database under a new file number.  The number
+  // stays in pending_outputs_ until the file has been added to the current
+  // version, so that RemoveObsoleteFiles() leaves it alone.
+  uint64_t number;
+  {
+    MutexLock l(&mutex_);
+    number = versions_->NewFileNumber();
+    pending_outputs_.insert(number);
+  }
+  const std::string table_name = TableFileName(dbname_, number);
+  s = env_->RenameFile(fname, table_name);
+  if (!s.ok()) {
+    MutexLock l(&mutex_);
+    pending_outputs_.erase(number);
+    return s;
+  }
+
+  // Find the file's key range.  SstFileWriter writes every entry with
+  // sequence number zero and no range tombstones.
+  ParsedInternalKey ikey;
+  std::string smallest_user_key, largest_user_key;
+  ValueType smallest_type = kTypeValue;
+  ValueType largest_type = kTypeValue;
+  Iterator* iter = table_cache_->NewIterator(ReadOptions(), number, file_size,
+                                             0);
+  iter->SeekToFirst();
+  if (iter->Valid()) {
+    if (ParseInternalKey(iter->key(), &ikey) && ikey.sequence == 0 &&
+        ikey.type != kTypeRangeDeletion) {
+      smallest_user_key = ikey.user_key.ToString();
+      smallest_type = ikey.type;
+    } else {
+      s = Status::InvalidArgument(fname, "not built by SstFileWriter");
+    }
+    iter->SeekToLast();
+  }
+  if (s.ok() && iter->Valid()) {
+    if (ParseInternalKey(iter->key(), &ikey) && ikey.sequence == 0 &&
+        ikey.type != kTypeRangeDeletion) {
+      largest_user_key = ikey.user_key.ToString();
+      largest_type = ikey.type;
+    } else {
+      s = Status::InvalidArgument(fname, "not built by SstFileWriter");
+    }
+  } else if (s.ok()) {
+    s = iter->status();
+    if (s.ok()) {
+      s = Status::InvalidArgument(fname, "empty table");
+    }
+  }
+  delete iter;
+  if (s.ok()) {
+    RangeTombstoneList range_dels(user_comparator());
+    s = table_cache_->AddRangeTombstones(number, file_size, &range_dels);
+    if (s.ok() && !range_dels.empty()) {
+      s = Status::InvalidArgument(fname, "not built by SstFileWriter");
+    }
+  }
+  // The table was opened without its global sequence number.
+  table_cache_->Evict(number);
+  if (!s.ok()) {
+    env_->RenameFile(table_name, fname);
+    MutexLock l(&mutex_);
+    pending_outputs_.erase(number);
+    return s;
+  }
+
+  // Block writes by taking the front of the writer queue, so that no
+  // write group is inserting into mem_ or holding sequence numbers that
+  // have not been published yet.
+  Writer w(&mutex_);
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  AwaitWriterTurn(&w);
+  while (!memtable_writers_.empty()) {
+    // Pipelined write groups are still inserting into mem_.
+    background_work_finished_signal_.Wait();
+  }
+  s = bg_error_;
+
+  // Reads search the memtables before the tables, so any memtable data
+  // in the file's range has to reach a table first.
+  const Slice smallest(smallest_user_key);
+  const Slice largest(largest_user_key);
+  if (s.ok() && MemTableOverlaps(mem_, user_comparator(), smallest, largest)) {
+    s = MakeRoomForWrite(true /* force */);
+  }
+  if (s.ok()) {
+    bool imm_overlaps = false;
+    for (const ImmutableMemTable& imm : imm_) {
+      if (MemTableOverlaps(imm.mem, user_comparator(), smallest, largest)) {
+        imm_overlaps = true;
+      }
+    }
+    if (imm_overlaps) {
+      while (!imm_.empty() && bg_error_.ok()) {
+        background_work_finished_signal_.Wait();
+      }
+      s = bg_error_;
+    }
+  }
+
+  int level = 0;
+  SequenceNumber sequence = 0;
+  if (s.ok()) {
+    // Choose the level against the version that the edit will be applied
+    // to; LogAndApply() below does not release mutex_ before applying it.
+    while (manifest_write_in_progress_) {
+      manifest_write_finished_signal_.Wait();
+    }
+    Version* current = versions_->current();
+    if (!current->OverlapInLevel(0, &smallest, &largest)) {
+      while (level + 1 < config::kNumLevels &&
+             !current->OverlapInLevel(level + 1, &smallest, &largest) &&
+             !versions_->RangeBeingCompactedInto(level + 1, smallest,
+                                                 largest)) {
+        level++;
+      }
+    }
+
+    sequence = versions_->LastSequence() + 1;
+    FileMetaData meta;
+    meta.number = number;
+    meta.file_size = file_size;
+    meta.smallest = InternalKey(smallest, sequence, smallest_type);
+    meta.largest = InternalKey(largest, sequence, largest_type);
+    meta.global_sequence = sequence;
+    VersionEdit edit;
+    edit.AddFile(level, meta);
+    versions_->SetLastSequence(sequence);
+    s = LogAndApply(&edit);
+    if (!s.ok()) {
+      RecordBackgroundError(s);
+    }
+  }
+  pending_outputs_.erase(number);
+
+  Log(options_.info_log, "Ingested table #%llu at level %d: %lld bytes %s",
+      static_cast<unsigned long long>(number), level,
+      static_cast<long long>(file_size), s.ToString().c_str());
+  if (s.ok()) {
+    MaybeScheduleCompaction();
+  } else {
+    // Give the file back to the caller.
+    env_->RenameFile(table_name, fname);
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -631,7 +1003,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   }
   // Finish current background compaction in the case where
   // `background_work_finished_signal_` was signalled due to an error.
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   if (manual_compaction_ == &manual) {
@@ -646,10 +1018,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -664,20 +1036,66 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+void DBImpl::MaybeScheduleFlush() {
+  mutex_.AssertHeld();
+  if (background_flush_scheduled_) {
+    // Already scheduled
+  } else if (shutting_down_.load(std::memory_order_acquire)) {
+    // DB is being deleted; no more background flushes
+  } else if (!bg_error_.ok()) {
+    // Already got an error; no more changes
+  } else if (imm_.empty() || imm_flush_in_progress_) {
+    // No work to be done, or the thread that is flushing will
+    // reschedule us when it is done.
+  } else {
+    background_flush_scheduled_ = true;
+    env_->ScheduleWithPriority(&DBImpl::BGFlushWork, this, Env::kHigh);
+  }
+}
+
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  while (!shutting_down_.load(std::memory_order_acquire) && bg_error_.ok() &&
+         !imm_.empty() && !imm_flush_in_progress_) {
+    CompactMemTable();
+    // Wake up MakeRoomForWrite() if necessary.
+    background_work_finished_signal_.SignalAll();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 files may need to be compacted.
+  MaybeScheduleFlush();
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
     // Already scheduled
   } else if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+  } else if (manual_compaction_ != nullptr) {
+    if (background_compactions_scheduled_ == 0) {
+      // Manual compactions run alone; the last compaction to finish
+      // schedules them otherwise.
+      background_compactions_scheduled_++;
+      env_->ScheduleWithPriority(&DBImpl::BGWork, this, Env::kLow);
+    }
+  } else if (!versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    background_compactions_scheduled_++;
+    env_->ScheduleWithPriority(&DBImpl::BGWork, this, Env::kLow);
   }
 }
 
@@ -687,35 +1105,39 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    did_work = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  If nothing could be
+  // picked, the compactions still running will reschedule when they
+  // finish.
+  if (did_work || manual_compaction_ != nullptr) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
-  }
-
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
   if (is_manual) {
+    if (versions_->NumRunningCompactions() > 0) {
+      // Wait for the running compactions to finish first.
+      return false;
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -729,6 +1151,12 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      return false;
+    }
+    // Let another thread look for a compaction that can run alongside
+    // this one.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -739,9 +1167,8 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -750,6 +1177,7 @@ void DBImpl::BackgroundCompaction() {
         static_cast<unsigned long long>(f->number), c->level() + 1,
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
+    versions_->ReleaseCompaction(c);
   } else {
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
@@ -757,6 +1185,7 @@ void DBImpl::BackgroundCompaction() {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    versions_->ReleaseCompaction(c);
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
@@ -783,6 +1212,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -814,13 +1244,20 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = options_.use_direct_io_for_flush_and_compaction
+                 ? env_->NewDirectWritableFile(fname, &compact->outfile)
+                 : env_->NewWritableFile(fname, &compact->outfile);
+  if (options_.use_direct_io_for_flush_and_compaction &&
+      s.IsNotSupportedError()) {
+    s = Status::NotSupported(fname, "use_direct_io_for_flush_and_compaction");
+  }
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
@@ -862,8 +1299,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
 
   if (s.ok() && current_entries > 0) {
     // Verify that the table is usable
-    Iterator* iter =
-        table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
+    Iterator* iter = table_cache_->NewIterator(ReadOptions(), output_number,
+                                               current_bytes, 0);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -876,6 +1313,57 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+void DBImpl::AddOutputRangeTombstones(CompactionState* compact,
+                                      const std::string* lower,
+                                      const Slice* upper) {
+  assert(compact->builder != nullptr);
+  const Comparator* ucmp = user_comparator();
+  std::vector<std::pair<InternalKey, Slice>> pieces;
+  for (const RangeTombstone& t : *compact->output_tombstones) {
+    Slice begin = t.begin;
+    Slice end = t.end;
+    if (lower != nullptr && ucmp->Compare(begin, *lower) < 0) {
+      begin = *lower;
+    }
+    if (upper != nullptr && ucmp->Compare(end, *upper) > 0) {
+      end = *upper;
+    }
+    if (ucmp->Compare(begin, end) < 0) {
+      pieces.emplace_back(InternalKey(begin, t.seq, kTypeRangeDeletion), end);
+    }
+  }
+  // Sort by start key, longest first among pieces with the same start.
+  const InternalKeyComparator* icmp = &internal_comparator_;
+  std::sort(pieces.begin(), pieces.end(),
+            [icmp, ucmp](const std::pair<InternalKey, Slice>& a,
+                         const std::pair<InternalKey, Slice>& b) {
+              int r = icmp->Compare(a.first, b.first);
+              return r < 0 || (r == 0 && ucmp->Compare(a.second, b.second) > 0);
+            });
+
+  // A piece [begin, end) spans from its own start key to just before
+  // every entry for "end".
+  CompactionState::Output* out = compact->current_output();
+  bool has_bounds = compact->builder->NumEntries() > 0;
+  for (size_t i = 0; i < pieces.size(); i++) {
+    if (i > 0 && icmp->Compare(pieces[i].first, pieces[i - 1].first) == 0) {
+      continue;  // Covered by the previous piece of the same tombstone
+    }
+    compact->builder->AddRangeTombstone(pieces[i].first.Encode(),
+                                        pieces[i].second);
+    out->has_range_deletions = true;
+    InternalKey largest(pieces[i].second, kMaxSequenceNumber,
+                        kTypeRangeDeletion);
+    if (!has_bounds || icmp->Compare(pieces[i].first, out->smallest) < 0) {
+      out->smallest = pieces[i].first;
+    }
+    if (!has_bounds || icmp->Compare(largest, out->largest) > 0) {
+      out->largest = largest;
+    }
+    has_bounds = true;
+  }
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -889,14 +1377,77 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+                                         out.smallest, out.largest,
+                                         out.has_range_deletions);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
+}
+
+// A piece of a compaction's key range.
+struct DBImpl::Subcompaction {
+  CompactionState* compact;
+  Iterator* input;
+  const std::string* begin;  // null means beginning of key range
+  const std::string* end;    // null means end of key range
+  Status status;
+};
+
+// The pieces of one compaction.  The compacting thread and the Env::kLow
+// pool threads it schedules take turns claiming pieces until none are
+// left, so the compaction finishes even if no pool thread is free.  A
+// pool thread may only start after every piece is done, so the group is
+// shared with the pool threads instead of living on the stack.
+struct DBImpl::SubcompactionGroup {
+  SubcompactionGroup(DBImpl* db, size_t num_subs)
+      : db(db), subs(num_subs), next(0), done_cv(&mu), done(0) {}
+
+  // Compact unclaimed pieces until there are none left.  Returns the
+  // micros this thread spent on imm_ compactions meanwhile.
+  int64_t Work() {
+    int64_t imm_micros = 0;
+    size_t finished = 0;
+    size_t i;
+    while ((i = next.fetch_add(1, std::memory_order_relaxed)) < subs.size()) {
+      Subcompaction* sub = &subs[i];
+      sub->status = db->DoCompactionRange(sub->compact, sub->input,
+                                          sub->begin, sub->end, &imm_micros);
+      finished++;
+    }
+    if (finished > 0) {
+      MutexLock l(&mu);
+      done += finished;
+      if (done == subs.size()) {
+        done_cv.SignalAll();
+      }
+    }
+    return imm_micros;
+  }
+
+  void WaitForAll() {
+    MutexLock l(&mu);
+    while (done < subs.size()) {
+      done_cv.Wait();
+    }
+  }
+
+  DBImpl* const db;
+  std::vector<Subcompaction> subs;
+  std::atomic<size_t> next;
+
+  port::Mutex mu;
+  port::CondVar done_cv GUARDED_BY(mu);
+  size_t done GUARDED_BY(mu);
+};
+
+void DBImpl::BGSubcompaction(void* arg) {
+  std::shared_ptr<SubcompactionGroup>* group =
+      reinterpret_cast<std::shared_ptr<SubcompactionGroup>*>(arg);
+  (*group)->Work();
+  delete group;
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -912,37 +1463,192 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Collect the range tombstones of the inputs.  Those that every snapshot
+  // sees and that cover no data below the output level are dropped.
+  Compaction* const c = compact->compaction;
+  RangeTombstoneList range_dels(user_comparator());
+  size_t num_level_tombstones = 0;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      FileMetaData* f = c->input(which, i);
+      if (f->has_range_deletions) {
+        Status s = table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                    &range_dels);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    if (which == 0) {
+      num_level_tombstones = range_dels.tombstones().size();
+    }
+  }
+  range_dels.Finish();
+  std::vector<RangeTombstone> output_tombstones;
+  for (const RangeTombstone& t : range_dels.tombstones()) {
+    if (t.seq > compact->smallest_snapshot ||
+        !c->IsBaseLevelForRange(t.begin, t.end)) {
+      output_tombstones.push_back(t);
+    }
+  }
+  if (num_level_tombstones > 0) {
+    const std::vector<RangeTombstone> level_tombstones(
+        range_dels.tombstones().begin(),
+        range_dels.tombstones().begin() + num_level_tombstones);
+    const int dropped =
+        c->DropCoveredInputs(level_tombstones, compact->smallest_snapshot);
+    if (dropped > 0) {
+      Log(options_.info_log, "Dropping %d@%d files deleted by range tombstones",
+          dropped, c->level() + 1);
+    }
+  }
+  compact->range_dels = range_dels.empty() ? nullptr : &range_dels;
+  compact->output_tombstones = &output_tombstones;
+
+  // Split the key range so that its pieces can be compacted in parallel.
+  // The first piece is compacted into *compact.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  std::shared_ptr<SubcompactionGroup> group =
+      std::make_shared<SubcompactionGroup>(this, boundaries.size() + 1);
+  std::vector<Subcompaction>& subs = group->subs;
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = &subs[i];
+    if (i == 0) {
+      sub->compact = compact;
+    } else {
+      sub->compact =
+          new CompactionState(compact->compaction->NewSubcompaction());
+      sub->compact->smallest_snapshot = compact->smallest_snapshot;
+      sub->compact->range_dels = compact->range_dels;
+      sub->compact->output_tombstones = compact->output_tombstones;
+    }
+    sub->input = versions_->MakeInputIterator(sub->compact->compaction);
+    sub->begin = (i == 0) ? nullptr : &boundaries[i - 1];
+    sub->end = (i == boundaries.size()) ? nullptr : &boundaries[i];
+  }
+  if (subs.size() > 1) {
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(subs.size()));
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  for (size_t i = 1; i < subs.size(); i++) {
+    env_->ScheduleWithPriority(&DBImpl::BGSubcompaction,
+                               new std::shared_ptr<SubcompactionGroup>(group),
+                               Env::kLow);
+  }
+  // Micros this thread spent doing imm_ compactions.  Those of the pool
+  // threads overlap with this thread's compaction work, so they are not
+  // subtracted from the time the compaction took.
+  const int64_t imm_micros = group->Work();
+  group->WaitForAll();
+
+  Status status;
+  for (Subcompaction& sub : subs) {
+    if (status.ok()) {
+      status = sub.status;
+    }
+    delete sub.input;
+  }
+
+  mutex_.Lock();
+  // Collect the outputs of the other pieces, which follow the outputs of
+  // the first piece in key order.
+  for (size_t i = 1; i < subs.size(); i++) {
+    CompactionState* sub = subs[i].compact;
+    Compaction* c = sub->compaction;
+    compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                            sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    sub->outputs.clear();
+    CleanupCompaction(sub);
+    delete c;
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact, Iterator* input,
+                                 const std::string* begin,
+                                 const std::string* end,
+                                 int64_t* imm_micros) {
+  if (begin == nullptr) {
+    input->SeekToFirst();
+  } else {
+    InternalKey start(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // Start of the key range of the current output.  The range tombstones
+  // in it are written to the output when it is finished.
+  const std::string* output_lower = begin;
+  std::string output_lower_storage;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
+    // Prioritize immutable compaction work.  Flushes normally run on their
+    // own thread, but an Env without a separate Env::kHigh pool queues
+    // them behind this compaction, so flush here unless one is running.
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (!imm_.empty() && !imm_flush_in_progress_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
+    if (end != nullptr && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key), *end) >= 0) {
+      // The rest of the key range belongs to another subcompaction.
+      break;
+    }
+    const bool stop_before = compact->compaction->ShouldStopBefore(key);
+    if (compact->builder != nullptr &&
+        (stop_before || compact->builder->FileSize() >=
+                            compact->compaction->MaxOutputFileSize())) {
+      // Outputs are only split between user keys, so that a key is always
+      // stored with the range tombstones covering it.
+      const Slice user_key = key.size() >= 8 ? ExtractUserKey(key) : key;
+      if (user_comparator()->Compare(
+              user_key, compact->current_output()->largest.user_key()) != 0) {
+        AddOutputRangeTombstones(compact, output_lower, &user_key);
+        status = FinishCompactionOutputFile(compact, input);
+        if (!status.ok()) {
+          break;
+        }
+        output_lower_storage.assign(user_key.data(), user_key.size());
+        output_lower = &output_lower_storage;
       }
     }
 
@@ -977,6 +1683,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (compact->range_dels != nullptr &&
+                 compact->range_dels->MaxCoveringSeq(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // Deleted by a range tombstone that every snapshot sees.  The
+        // tombstone itself is kept unless nothing below can hold the key.
+        drop = true;
       }
 
       last_sequence_for_key = ikey.sequence;
@@ -1004,15 +1717,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       }
       compact->current_output()->largest.DecodeFrom(key);
       compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
-      }
     }
 
     input->Next();
@@ -1021,37 +1725,30 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  Slice output_upper;
+  if (end != nullptr) {
+    output_upper = *end;
+  }
+  if (status.ok() && compact->builder == nullptr) {
+    // Range tombstones past the last key still need an output.
+    const Comparator* ucmp = user_comparator();
+    for (const RangeTombstone& t : *compact->output_tombstones) {
+      if ((output_lower == nullptr ||
+           ucmp->Compare(t.end, *output_lower) > 0) &&
+          (end == nullptr || ucmp->Compare(t.begin, output_upper) < 0)) {
+        status = OpenCompactionOutputFile(compact);
+        break;
+      }
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
+    AddOutputRangeTombstones(compact, output_lower,
+                             end != nullptr ? &output_upper : nullptr);
     status = FinishCompactionOutputFile(compact, input);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1059,53 +1756,172 @@ namespace {
 
 struct IterState {
   port::Mutex* const mu;
-  Version* const version GUARDED_BY(mu);
-  MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  SuperVersion* const sv;
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
-      : mu(mutex), version(version), mem(mem), imm(imm) {}
+  // The iterate bounds of the read options as the smallest internal keys
+  // with the bound user keys, for the table iterators.
+  InternalKey lower_bound;
+  InternalKey upper_bound;
+  Slice lower_bound_key;
+  Slice upper_bound_key;
+
+  IterState(port::Mutex* mutex, SuperVersion* sv) : mu(mutex), sv(sv) {}
 };
 
 static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
-  state->mu->Lock();
-  state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
-  state->version->Unref();
-  state->mu->Unlock();
+  if (state->sv->Unref()) {
+    state->mu->Lock();
+    state->sv->Cleanup();
+    state->mu->Unlock();
+  }
   delete state;
 }
 
 }  // anonymous namespace
 
-Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
-  mutex_.Lock();
-  *latest_snapshot = versions_->LastSequence();
+Iterator* DBImpl::NewInternalIterator(
+    const ReadOptions& options, SequenceNumber* latest_snapshot,
+    uint32_t* seed,
+    std::vector<std::shared_ptr<const RangeTombstoneList>>* range_dels) {
+  // The iterator keeps its own reference to the SuperVersion for as long
+  // as it lives.
+  SuperVersion* sv = AcquireSuperVersion();
+  sv->Ref();
+  ReleaseSuperVersion(sv);
+  *latest_snapshot = LastSequence();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
-  }
-  versions_->current()->AddIterators(options, &list);
+  list.push_back(sv->mem->NewIterator());
+  for (MemTable* imm : sv->imms) {
+    list.push_back(imm->NewIterator());
+  }
+  IterState* cleanup = new IterState(&mutex_, sv);
+  ReadOptions table_options = options;
+  if (options.iterate_lower_bound != nullptr) {
+    cleanup->lower_bound = InternalKey(*options.iterate_lower_bound,
+                                       kMaxSequenceNumber, kValueTypeForSeek);
+    cleanup->lower_bound_key = cleanup->lower_bound.Encode();
+    table_options.iterate_lower_bound = &cleanup->lower_bound_key;
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    cleanup->upper_bound = InternalKey(*options.iterate_upper_bound,
+                                       kMaxSequenceNumber, kValueTypeForSeek);
+    cleanup->upper_bound_key = cleanup->upper_bound.Encode();
+    table_options.iterate_upper_bound = &cleanup->upper_bound_key;
+  }
+  sv->current->AddIterators(table_options, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
-  *seed = ++seed_;
-  mutex_.Unlock();
+  *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+  if (range_dels != nullptr) {
+    // The lists are taken after *latest_snapshot, so they hold every
+    // tombstone visible to the iterator.
+    range_dels->clear();
+    std::vector<MemTable*> mems = sv->imms;
+    mems.push_back(sv->mem);
+    for (MemTable* m : mems) {
+      std::shared_ptr<const RangeTombstoneList> list = m->GetRangeTombstones();
+      if (list != nullptr) {
+        range_dels->push_back(list);
+      }
+    }
+    std::shared_ptr<const RangeTombstoneList> list;
+    Status s = sv->current->GetRangeTombstones(&list);
+    if (!s.ok()) {
+      range_dels->clear();
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    if (list != nullptr) {
+      range_dels->push_back(list);
+    }
+  }
   return internal_iter;
 }
 
+std::vector<MemTable*> DBImpl::RefImmutableMemTables() {
+  mutex_.AssertHeld();
+  std::vector<MemTable*> imms;
+  imms.reserve(imm_.size());
+  for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+    it->mem->Ref();
+    imms.push_back(it->mem);
+  }
+  return imms;
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  if (mem_ == nullptr) {
+    // Still recovering; DB::Open() installs the first SuperVersion.
+    return;
+  }
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->mem->Ref();
+  sv->imms = RefImmutableMemTables();
+  sv->current = versions_->current();
+  sv->current->Ref();
+  sv->Ref();
+  SuperVersion* old = super_version_;
+  super_version_ = sv;
+
+  // Drop the cached references so that later reads pick up sv.  Reads in
+  // progress notice the missing marker when they finish and drop their
+  // reference themselves.
+  std::vector<void*> cached;
+  local_super_version_.Scrape(&cached, nullptr);
+  for (void* ptr : cached) {
+    if (ptr != kSuperVersionInUse) {
+      SuperVersion* cached_sv = static_cast<SuperVersion*>(ptr);
+      if (cached_sv->Unref()) {
+        cached_sv->Cleanup();
+      }
+    }
+  }
+  if (old != nullptr && old->Unref()) {
+    old->Cleanup();
+  }
+}
+
+SequenceNumber DBImpl::LastSequence() const {
+  return versions_->LastSequence();
+}
+
+SuperVersion* DBImpl::AcquireSuperVersion() {
+  void* ptr = local_super_version_.Swap(kSuperVersionInUse);
+  assert(ptr != kSuperVersionInUse);
+  if (ptr != nullptr) {
+    return static_cast<SuperVersion*>(ptr);
+  }
+  // First read on this thread since the last InstallSuperVersion().
+  MutexLock l(&mutex_);
+  super_version_->Ref();
+  return super_version_;
+}
+
+void DBImpl::ReleaseSuperVersion(SuperVersion* sv) {
+  void* expected = kSuperVersionInUse;
+  if (!local_super_version_.CompareAndSwap(sv, &expected)) {
+    // A newer SuperVersion was installed during the read, so sv must not
+    // be cached.
+    assert(expected == nullptr);
+    UnrefSuperVersion(sv);
+  }
+}
+
+void DBImpl::UnrefSuperVersion(SuperVersion* sv) {
+  if (sv->Unref()) {
+    MutexLock l(&mutex_);
+    sv->Cleanup();
+  }
+}
+
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
@@ -1120,60 +1936,144 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
   Status s;
-  MutexLock l(&mutex_);
+  SuperVersion* sv = AcquireSuperVersion();
   SequenceNumber snapshot;
   if (options.snapshot != nullptr) {
     snapshot =
         static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
   } else {
-    snapshot = versions_->LastSequence();
+    snapshot = LastSequence();
   }
 
-  MemTable* mem = mem_;
-  MemTable* imm = imm_;
-  Version* current = versions_->current();
-  mem->Ref();
-  if (imm != nullptr) imm->Ref();
-  current->Ref();
-
-  bool have_stat_update = false;
+  // First look in the memtable, then in the immutable memtables (if
+  // any) from newest to oldest.
+  LookupKey lkey(key, snapshot);
   Version::GetStats stats;
+  stats.seek_file = nullptr;
+  bool found = sv->mem->Get(lkey, value, &s);
+  for (size_t i = 0; !found && i < sv->imms.size(); i++) {
+    found = sv->imms[i]->Get(lkey, value, &s);
+  }
+  if (!found) {
+    s = sv->current->Get(options, lkey, value, &stats);
+  }
+
+  // Only charging a seek to a file needs mutex_.
+  if (stats.seek_file != nullptr) {
+    MutexLock l(&mutex_);
+    if (sv->current->UpdateStats(stats)) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReleaseSuperVersion(sv);
+  return s;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const size_t n = keys.size();
+  std::vector<Status> statuses(n);
+  values->resize(n);
+  if (n == 0) {
+    return statuses;
+  }
 
-  // Unlock while reading from files and memtables
+  SuperVersion* sv = AcquireSuperVersion();
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = LastSequence();
+  }
+
+  std::vector<Version::GetStats> stats;
   {
-    mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
-    LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
-      have_stat_update = true;
+    // Probe in key order so that neighbouring keys hit the same tables
+    // and blocks back to back.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    const Comparator* ucmp = user_comparator();
+    std::stable_sort(order.begin(), order.end(),
+                     [ucmp, &keys](size_t a, size_t b) {
+                       return ucmp->Compare(keys[a], keys[b]) < 0;
+                     });
+
+    std::vector<LookupKey*> lkeys(n);
+    std::vector<const LookupKey*> pending_keys;
+    std::vector<std::string*> pending_values;
+    std::vector<size_t> pending_index;
+    for (size_t i : order) {
+      lkeys[i] = new LookupKey(keys[i], snapshot);
+      std::string* value = &(*values)[i];
+      bool found = sv->mem->Get(*lkeys[i], value, &statuses[i]);
+      for (size_t j = 0; !found && j < sv->imms.size(); j++) {
+        found = sv->imms[j]->Get(*lkeys[i], value, &statuses[i]);
+      }
+      if (!found) {
+        pending_keys.push_back(lkeys[i]);
+        pending_values.push_back(value);
+        pending_index.push_back(i);
+      }
+    }
+
+    if (!pending_keys.empty()) {
+      std::vector<Status> pending_statuses;
+      sv->current->MultiGet(options, pending_keys, pending_values,
+                        &pending_statuses, &stats);
+      for (size_t i = 0; i < pending_index.size(); i++) {
+        statuses[pending_index[i]] = pending_statuses[i];
+      }
+    }
+
+    for (LookupKey* lkey : lkeys) {
+      delete lkey;
     }
-    mutex_.Lock();
   }
 
-  if (have_stat_update && current->UpdateStats(stats)) {
-    MaybeScheduleCompaction();
+  // Only charging seeks to files needs mutex_.
+  bool have_seek = false;
+  for (const Version::GetStats& stat : stats) {
+    if (stat.seek_file != nullptr) {
+      have_seek = true;
+    }
   }
-  mem->Unref();
-  if (imm != nullptr) imm->Unref();
-  current->Unref();
-  return s;
+  if (have_seek) {
+    MutexLock l(&mutex_);
+    bool need_compaction = false;
+    for (const Version::GetStats& stat : stats) {
+      if (sv->current->UpdateStats(stat)) {
+        need_compaction = true;
+      }
+    }
+    if (need_compaction) {
+      MaybeScheduleCompaction();
+    }
+  }
+  ReleaseSuperVersion(sv);
+  return statuses;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_dels);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, std::move(range_dels),
+                       (options.prefix_same_as_start
+                            ? internal_prefix_extractor_.user_transform()
+                            : nullptr),
+                       options.iterate_lower_bound,
+                       options.iterate_upper_bound);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1202,7 +2102,21 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin_key,
+                           const Slice& end_key) {
+  if (user_comparator()->Compare(begin_key, end_key) > 0) {
+    return Status::InvalidArgument("DeleteRange end key comes before begin key");
+  }
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(options, &batch);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1210,9 +2124,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
-    w.cv.Wait();
-  }
+  AwaitWriterTurn(&w);
   if (w.done) {
     return w.status;
   }
@@ -1222,9 +2134,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
-    last_sequence += WriteBatchInternal::Count(write_batch);
+    const bool parallel =
+        options_.allow_concurrent_memtable_write && last_writer != &w;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1240,7 +2153,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1251,6 +2164,15 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && parallel) {
+      std::vector<Writer*> group;
+      for (Writer* writer : writers_) {
+        group.push_back(writer);
+        if (writer == last_writer) break;
+      }
+      status = InsertInParallel(group, mem_, last_sequence + 1);
+    }
+    last_sequence += WriteBatchInternal::Count(write_batch);
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1275,9 +2197,170 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  AwaitWriterTurn(&w);
+  if (w.done) {
+    return w.status;
+  }
+
+  // Stage 1: append the group to the log.  Only the writer at the front
+  // of writers_ may touch log_, but earlier groups may still be inserting
+  // into mem_ while we do this.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  Writer* last_writer = &w;
+  WriteBatch group_batch;
+  WriteBatch* write_batch = nullptr;
+  SequenceNumber last_sequence =
+      std::max(versions_->LastSequence(), last_allocated_sequence_);
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    write_batch = BuildBatchGroup(&last_writer, &group_batch);
+    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    last_sequence += WriteBatchInternal::Count(write_batch);
+    last_allocated_sequence_ = last_sequence;
+
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+
+  // Hand the log over to the next group.  The followers leave writers_
+  // here, before they are done, so AwaitWriterTurn() must not assume
+  // that a waiting writer is still queued.
+  std::vector<Writer*> followers;
+  while (true) {
+    assert(!writers_.empty());
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // Stage 2: insert into the memtable and publish the sequence number,
+  // in the same order in which the groups were logged.  MakeRoomForWrite()
+  // waits for this queue to drain before it retires mem_.
+  if (write_batch != nullptr) {
+    memtable_writers_.push_back(&w);
+    while (&w != memtable_writers_.front()) {
+      w.cv.Wait();
+    }
+    if (status.ok() && options_.allow_concurrent_memtable_write &&
+        !followers.empty()) {
+      std::vector<Writer*> group;
+      group.push_back(&w);
+      group.insert(group.end(), followers.begin(), followers.end());
+      status = InsertInParallel(group, mem_,
+                                WriteBatchInternal::Sequence(write_batch));
+    } else if (status.ok()) {
+      MemTable* mem = mem_;
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertInto(write_batch, mem);
+      mutex_.Lock();
+    }
+    versions_->SetLastSequence(last_sequence);
+    memtable_writers_.pop_front();
+    if (!memtable_writers_.empty()) {
+      memtable_writers_.front()->cv.Signal();
+    } else {
+      background_work_finished_signal_.SignalAll();
+    }
+  }
+
+  for (Writer* ready : followers) {
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
+  }
+  return status;
+}
+
+void DBImpl::AwaitWriterTurn(Writer* w) {
+  mutex_.AssertHeld();
+  while (true) {
+    if (w->insert_mem != nullptr) {
+      MemTable* mem = w->insert_mem;
+      mutex_.Unlock();
+      Status s =
+          WriteBatchInternal::InsertIntoConcurrently(w->batch, mem,
+                                                     w->insert_slot);
+      mutex_.Lock();
+      w->status = s;
+      w->insert_mem = nullptr;
+      if (--w->leader->pending_inserts == 0) {
+        w->leader->cv.Signal();
+      }
+    }
+    // A pipelined follower may already have been removed from writers_.
+    if (w->done || (!writers_.empty() && w == writers_.front())) {
+      return;
+    }
+    w->cv.Wait();
+  }
+}
+
+Status DBImpl::InsertInParallel(const std::vector<Writer*>& group,
+                                MemTable* mem, SequenceNumber sequence) {
+  mutex_.AssertHeld();
+  Writer* leader = group[0];
+  for (Writer* writer : group) {
+    if (writer->batch != nullptr) {
+      WriteBatchInternal::SetSequence(writer->batch, sequence);
+      sequence += WriteBatchInternal::Count(writer->batch);
+    }
+  }
+  for (size_t i = 1; i < group.size(); i++) {
+    Writer* follower = group[i];
+    if (follower->batch != nullptr) {
+      follower->leader = leader;
+      follower->insert_mem = mem;
+      follower->insert_slot = static_cast<int>(i);
+      leader->pending_inserts++;
+      follower->cv.Signal();
+    }
+  }
+
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem, 0);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (size_t i = 1; i < group.size() && status.ok(); i++) {
+    status = group[i]->status;
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1304,22 +2387,26 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == nullptr) {
+      // A writer without a batch must reach the front of the queue itself:
+      // it does work that must not run concurrently with other writes.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1353,15 +2440,19 @@ Status DBImpl::MakeRoomForWrite(bool force) {
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != nullptr) {
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
       // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+      // ones are still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
     } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined write groups are still inserting into mem_.
+      background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1392,12 +2483,13 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
-      imm_ = mem_;
+      imm_.push_back(ImmutableMemTable{mem_, new_log_number});
       has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
+      InstallSuperVersion();
       force = false;  // Do not force another compaction if have room
-      MaybeScheduleCompaction();
+      MaybeScheduleFlush();
     }
   }
   return s;
@@ -1452,8 +2544,8 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (const ImmutableMemTable& imm : imm_) {
+      total_usage += imm.mem->ApproximateMemoryUsage();
     }
     char buf[50];
     std::snprintf(buf, sizeof(buf), "%llu",
@@ -1497,6 +2589,30 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  return Status::NotSupported("DeleteRange");
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
+Status DB::IngestExternalFile(const std::string& fname) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  std::vector<Status> statuses(keys.size());
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses[i] = Get(options, keys[i], &(*values)[i]);
+  }
+  return statuses;
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1529,6 +2645,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
   }
   if (s.ok()) {
+    impl->InstallSuperVersion();
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
   }
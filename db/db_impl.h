@@ -7,8 +7,10 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
@@ -17,10 +19,13 @@
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneList;
+struct SuperVersion;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -39,15 +44,22 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin_key,
+                     const Slice& end_key) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  std::vector<Status> MultiGet(const ReadOptions& options,
+                               const std::vector<Slice>& keys,
+                               std::vector<std::string>* values) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status DeleteFilesInRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFile(const std::string& fname) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -74,6 +86,8 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct Subcompaction;
+  struct SubcompactionGroup;
   struct Writer;
 
   // Information for a manual compaction
@@ -101,9 +115,15 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+  // If range_dels is non-null, also stores the range tombstones of the
+  // memtables and version read by the iterator in *range_dels, one list
+  // per memtable or version that has any.  The lists are cached by the
+  // memtables and the version, not rebuilt per iterator.  On error,
+  // returns an error iterator.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+      std::vector<std::shared_ptr<const RangeTombstoneList>>* range_dels =
+          nullptr);
 
   Status NewDB();
 
@@ -127,27 +147,70 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
-      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Build a table from the contents of "*mem" and add it to *edit.  The
+  // table is added to level 0 unless "pick_level" is true, in which case
+  // it may be pushed to a deeper level of the current version.  The
+  // table's number is stored in *number and left in pending_outputs_ so
+  // that the table is not deleted before *edit is applied; the caller
+  // must remove it from pending_outputs_ afterwards.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, bool pick_level,
+                          uint64_t* number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Apply *edit to the current version through versions_->LogAndApply(),
+  // waiting for any other thread's LogAndApply() to finish first.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Implementation of Write() when options_.enable_pipelined_write is set.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Wait until *w is at the front of writers_ or has been completed as
+  // part of another writer's group.  Meanwhile, insert w's batch into
+  // the memtable if its group leader asks for that (see InsertInParallel).
+  void AwaitWriterTurn(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Have every writer in "group" insert its own batch into "mem" in
+  // parallel and wait for all of them.  group[0] must be the calling
+  // leader, and the batches are assigned consecutive sequence numbers
+  // starting at "sequence", in group order.
+  Status InsertInParallel(const std::vector<Writer*>& group, MemTable* mem,
+                          SequenceNumber sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
+  void MaybeScheduleFlush() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Run one compaction.  Returns false if there was nothing that could
+  // be compacted alongside the compactions that are already running.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Compact the input entries whose user keys fall in [*begin,*end) into
+  // new output files of *compact.  Runs without holding mutex_.
+  Status DoCompactionRange(CompactionState* compact, Iterator* input,
+                           const std::string* begin, const std::string* end,
+                           int64_t* imm_micros) LOCKS_EXCLUDED(mutex_);
+  static void BGSubcompaction(void* arg);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Add to the current output of *compact the parts of the compaction's
+  // range tombstones that fall in [lower, upper), where null means
+  // unbounded.
+  void AddOutputRangeTombstones(CompactionState* compact,
+                                const std::string* lower, const Slice* upper);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -155,10 +218,42 @@ class DBImpl : public DB {
     return internal_comparator_.user_comparator();
   }
 
+  // A memtable that is no longer written to and is waiting to be flushed
+  // to a level-0 table.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    // The log file that was started when mem was retired.  Once mem has
+    // been flushed, earlier log files are no longer needed.
+    uint64_t next_log_number;
+  };
+
+  // Ref and return the immutable memtables, newest first.
+  std::vector<MemTable*> RefImmutableMemTables()
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Replace super_version_ with a bundle of the current mem_, imm_ and
+  // version, and drop every thread's cached reference to the old one.
+  // Must be called whenever any of the three changes.
+  void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a referenced SuperVersion to read from.  Normally this is the
+  // calling thread's cached copy and mutex_ is not touched.
+  SuperVersion* AcquireSuperVersion() LOCKS_EXCLUDED(mutex_);
+
+  // Give back a SuperVersion obtained from AcquireSuperVersion().
+  void ReleaseSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+
+  // Drop a reference to sv, cleaning it up if it was the last one.
+  void UnrefSuperVersion(SuperVersion* sv) LOCKS_EXCLUDED(mutex_);
+
+  // Return versions_->LastSequence(), which may be read without mutex_.
+  SequenceNumber LastSequence() const NO_THREAD_SAFETY_ANALYSIS;
+
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -175,30 +270,54 @@ class DBImpl : public DB {
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Full memtables waiting to be compacted, oldest first.
+  std::deque<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // So bg thread can detect non-empty imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
-  uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
+  std::atomic<uint32_t> seed_;  // For sampling.
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Leaders of pipelined write groups that have been logged but not yet
+  // inserted into mem_, in sequence order.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
+  // Last sequence number handed out to a pipelined write group.  May be
+  // ahead of versions_->LastSequence() while groups are in flight.
+  SequenceNumber last_allocated_sequence_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a background flush of imm_ been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+  // Is some thread writing imm_.front() to a table right now?
+  bool imm_flush_in_progress_ GUARDED_BY(mutex_);
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
+  port::CondVar manifest_write_finished_signal_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
+  // The memtables and version that reads go to, holding one reference.
+  SuperVersion* super_version_ GUARDED_BY(mutex_);
+  // Each thread's cached reference to super_version_, so that reads do
+  // not have to take mutex_ to pin their state.  Cleared by
+  // InstallSuperVersion().
+  ThreadLocalPtr local_super_version_;
+
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
@@ -210,6 +329,7 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
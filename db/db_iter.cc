@@ -7,6 +7,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -46,13 +47,21 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed,
+         std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels,
+         const SliceTransform* prefix_extractor, const Slice* lower_bound,
+         const Slice* upper_bound)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        range_dels_(std::move(range_dels)),
+        prefix_extractor_(prefix_extractor),
+        lower_bound_(lower_bound),
+        upper_bound_(upper_bound),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -88,6 +97,37 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns the type of the entry, where values deleted by a range
+  // tombstone visible at sequence_ count as deletions.
+  ValueType EntryType(const ParsedInternalKey& ikey) const {
+    if (ikey.type == kTypeValue) {
+      for (const auto& range_dels : range_dels_) {
+        if (range_dels->MaxCoveringSeq(ikey.user_key, sequence_) >
+            ikey.sequence) {
+          return kTypeDeletion;
+        }
+      }
+    }
+    return ikey.type;
+  }
+
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return lower_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *lower_bound_) < 0;
+  }
+  bool AtOrAfterUpperBound(const Slice& user_key) const {
+    return upper_bound_ != nullptr &&
+           user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+  }
+
+  // Returns false if the last Seek() restricted the iterator to the keys
+  // sharing the prefix of its target and "user_key" does not.
+  bool InPrefix(const Slice& user_key) const {
+    return !prefix_bounded_ || (prefix_extractor_->InDomain(user_key) &&
+                                prefix_extractor_->Transform(user_key) ==
+                                    Slice(prefix_));
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,12 +149,18 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  const std::vector<std::shared_ptr<const RangeTombstoneList>> range_dels_;
+  const SliceTransform* const prefix_extractor_;
+  const Slice* const lower_bound_;
+  const Slice* const upper_bound_;
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
+  std::string prefix_;  // Prefix of the last Seek() target, if bounded
   Direction direction_;
   bool valid_;
+  bool prefix_bounded_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -180,9 +226,20 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+    if (!ParseKey(&ikey)) {
+      // Skip corrupted entries
+    } else if (AtOrAfterUpperBound(ikey.user_key)) {
+      // Stop before reading anything past the bound, including entries
+      // that are not visible at sequence_
+      break;
+    } else if (ikey.sequence <= sequence_) {
+      if (!InPrefix(ikey.user_key)) {
+        // Keys sharing a prefix are adjacent, so there are no more
+        break;
+      }
+      switch (EntryType(ikey)) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
@@ -209,6 +266,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
 void DBIter::Prev() {
   assert(valid_);
 
+  if (prefix_extractor_ != nullptr) {
+    status_ = Status::NotSupported("Prev() with prefix_same_as_start");
+    valid_ = false;
+    return;
+  }
+
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
@@ -240,13 +303,18 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (!ParseKey(&ikey)) {
+        // Skip corrupted entries
+      } else if (BeforeLowerBound(ikey.user_key)) {
+        // iter_ is now just before all entries for the saved key
+        break;
+      } else if (ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        value_type = EntryType(ikey);
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
@@ -276,11 +344,18 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  const Slice start = BeforeLowerBound(target) ? *lower_bound_ : target;
   direction_ = kForward;
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(start);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(start);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+                    ParsedInternalKey(start, sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -291,8 +366,16 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  prefix_bounded_ = false;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  if (lower_bound_ != nullptr) {
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(*lower_bound_, sequence_,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
   } else {
@@ -301,9 +384,28 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  if (prefix_extractor_ != nullptr) {
+    status_ = Status::NotSupported("SeekToLast() with prefix_same_as_start");
+    valid_ = false;
+    return;
+  }
   direction_ = kReverse;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Position just before all entries for the bound
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+                      ParsedInternalKey(*upper_bound_, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
@@ -311,8 +413,14 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed,
+                        std::vector<std::shared_ptr<const RangeTombstoneList>>
+                            range_dels,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    std::move(range_dels), prefix_extractor, lower_bound,
+                    upper_bound);
 }
 
 }  // namespace leveldb
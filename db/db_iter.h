@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/db.h"
@@ -13,13 +15,23 @@
 namespace leveldb {
 
 class DBImpl;
+class RangeTombstoneList;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries deleted by the tombstones in any
+// of the "range_dels" lists are skipped.  If "prefix_extractor" is
+// non-null, Seek() only yields
+// the keys that share the prefix of its target (see
+// ReadOptions::prefix_same_as_start).  Only the user keys in
+// ["*lower_bound", "*upper_bound") are yielded; either bound may be null.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed,
+                        std::vector<std::shared_ptr<const RangeTombstoneList>>
+                            range_dels,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound);
 
 }  // namespace leveldb
 
@@ -7,6 +7,7 @@
 #include <atomic>
 #include <cinttypes>
 #include <string>
+#include <thread>
 
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
@@ -16,6 +17,8 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -32,6 +35,12 @@ static std::string RandomString(Random* rnd, int len) {
   return r;
 }
 
+static std::string Key(int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
 static std::string RandomKey(Random* rnd) {
   int len =
       (rnd->OneIn(3) ? 1  // Short sometimes to encourage collisions
@@ -141,6 +150,18 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Return random reads in the caller's buffer, like files that are not
+  // memory-mapped, while this is true.
+  bool copy_random_reads_;
+
+  // Simulate a file system without direct I/O while this is true.
+  std::atomic<bool> no_direct_io_;
+
+  // Number of files opened for direct or memory-mapped I/O.
+  AtomicCounter direct_reads_opened_;
+  AtomicCounter direct_writes_opened_;
+  AtomicCounter mmap_reads_opened_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -150,7 +171,9 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        copy_random_reads_(false),
+        no_direct_io_(false) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -247,14 +270,76 @@ class SpecialEnv : public EnvWrapper {
         counter_->Increment();
         return target_->Read(offset, n, result, scratch);
       }
+      // A batch counts as one read.
+      void MultiRead(ReadRequest* reqs, size_t num_reqs) const override {
+        counter_->Increment();
+        target_->MultiRead(reqs, num_reqs);
+      }
+    };
+
+    class CopyingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+
+     public:
+      explicit CopyingFile(RandomAccessFile* target) : target_(target) {}
+      ~CopyingFile() override { delete target_; }
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const override {
+        Status s = target_->Read(offset, n, result, scratch);
+        if (s.ok() && result->data() != scratch) {
+          std::memcpy(scratch, result->data(), result->size());
+          *result = Slice(scratch, result->size());
+        }
+        return s;
+      }
+      void MultiRead(ReadRequest* reqs, size_t num_reqs) const override {
+        target_->MultiRead(reqs, num_reqs);
+        for (size_t i = 0; i < num_reqs; i++) {
+          ReadRequest* req = &reqs[i];
+          if (req->status.ok() && req->result.data() != req->scratch) {
+            std::memcpy(req->scratch, req->result.data(), req->result.size());
+            req->result = Slice(req->scratch, req->result.size());
+          }
+        }
+      }
     };
 
     Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok() && copy_random_reads_) {
+      *r = new CopyingFile(*r);
+    }
     if (s.ok() && count_random_reads_) {
       *r = new CountingFile(*r, &random_read_counter_);
     }
     return s;
   }
+
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    direct_reads_opened_.Increment();
+    if (no_direct_io_.load(std::memory_order_acquire)) {
+      *r = nullptr;
+      return Status::NotSupported(f, "direct I/O");
+    }
+    return target()->NewDirectRandomAccessFile(f, r);
+  }
+
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    direct_writes_opened_.Increment();
+    if (no_direct_io_.load(std::memory_order_acquire)) {
+      *r = nullptr;
+      return Status::NotSupported(f, "direct I/O");
+    }
+    return target()->NewDirectWritableFile(f, r);
+  }
+
+  Status NewMmapRandomAccessFile(const std::string& f,
+                                 RandomAccessFile** r) override {
+    mmap_reads_opened_.Increment();
+    return target()->NewMmapRandomAccessFile(f, r);
+  }
 };
 
 class DBTest : public testing::Test {
@@ -267,6 +352,7 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    cache_local_filter_policy_ = NewCacheLocalBloomFilterPolicy(10);
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -276,8 +362,12 @@ class DBTest : public testing::Test {
   ~DBTest() {
     delete db_;
     DestroyDB(dbname_, Options());
+    // Tests may grow the process-wide kLow pool; restore its default size
+    // even if they fail part way.
+    env_->SetBackgroundThreads(1, Env::kLow);
     delete env_;
     delete filter_policy_;
+    delete cache_local_filter_policy_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -303,9 +393,28 @@ class DBTest : public testing::Test {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kFullFilter:
+        options.filter_policy = cache_local_filter_policy_;
+        options.full_filter = true;
+        break;
+      case kPartitionedIndex:
+        options.filter_policy = filter_policy_;
+        options.partition_index_and_filters = true;
+        options.metadata_block_size = 256;  // Several partitions per table
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kPipelinedConcurrentWrite:
+        options.enable_pipelined_write = true;
+        options.allow_concurrent_memtable_write = true;
+        break;
       default:
         break;
     }
@@ -391,6 +500,38 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Reopen with "*options", write keys over several memtable flushes,
+  // compact them, and check that lookups and, after reopening again, a
+  // full scan return every value.
+  void FillCompactAndScan(Options* options) {
+    Reopen(options);
+    const int N = 2000;
+    Random rnd(301);
+    std::vector<std::string> values;
+    for (int i = 0; i < N; i++) {
+      values.push_back(RandomString(&rnd, 100 + i % 500));
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+      if (i % 500 == 499) {
+        dbfull()->TEST_CompactMemTable();
+      }
+    }
+    Compact(Key(0), Key(N));
+    for (int i = 0; i < N; i += 3) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+
+    Reopen(options);
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_EQ(Key(i), iter->key().ToString());
+      ASSERT_EQ(values[i], iter->value().ToString());
+    }
+    ASSERT_LEVELDB_OK(iter->status());
+    ASSERT_EQ(N, i);
+    delete iter;
+  }
+
   std::string AllEntriesFor(const Slice& user_key) {
     Iterator* iter = dbfull()->TEST_NewInternalIterator();
     InternalKey target(user_key, kMaxSequenceNumber, kTypeValue);
@@ -420,6 +561,9 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -562,9 +706,21 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kFullFilter,
+    kPartitionedIndex,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kPipelinedConcurrentWrite,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const FilterPolicy* cache_local_filter_policy_;
   int option_config_;
 };
 
@@ -637,6 +793,45 @@ TEST_F(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetFromMultipleImmutableMemTables) {
+  do {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.max_write_buffer_number = 4;
+    Reopen(&options);
+
+    // Block sync calls so that no memtable can be flushed.
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_LEVELDB_OK(Put("k1", std::string(100000, 'x')));  // Fill memtable
+    ASSERT_LEVELDB_OK(Put("foo", "v2"));  // Retires first memtable
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("k2", std::string(100000, 'y')));
+    ASSERT_LEVELDB_OK(Put("foo", "v3"));  // Retires second memtable
+    ASSERT_LEVELDB_OK(Put("k3", std::string(100000, 'z')));
+
+    // Two full memtables are queued behind the blocked flush, and reads
+    // must consult them newest first.
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_EQ("v2", Get("foo", snapshot));
+    ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+    ASSERT_EQ("[ v3, v2, v1 ]", AllEntriesFor("foo"));
+    ASSERT_EQ(0, NumTableFilesAtLevel(0));
+    db_->ReleaseSnapshot(snapshot);
+
+    // Release sync calls and close the DB before all queued memtables are
+    // flushed; their logs must survive so that recovery sees everything.
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    Reopen(&options);
+    ASSERT_EQ("v3", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+    ASSERT_EQ(std::string(100000, 'y'), Get("k2"));
+    ASSERT_EQ(std::string(100000, 'z'), Get("k3"));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetFromVersions) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -645,6 +840,53 @@ TEST_F(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+
+    std::vector<Slice> keys = {"e", "d", "a", "c", "b", "a"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses =
+        db_->MultiGet(ReadOptions(), keys, &values);
+    ASSERT_EQ(keys.size(), statuses.size());
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_LEVELDB_OK(statuses[2]);
+    ASSERT_EQ("va2", values[2]);
+    ASSERT_LEVELDB_OK(statuses[3]);
+    ASSERT_EQ("vc2", values[3]);
+    ASSERT_LEVELDB_OK(statuses[4]);
+    ASSERT_EQ("vb", values[4]);
+    ASSERT_LEVELDB_OK(statuses[5]);
+    ASSERT_EQ("va2", values[5]);
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    statuses = db_->MultiGet(options, keys, &values);
+    ASSERT_LEVELDB_OK(statuses[2]);
+    ASSERT_EQ("va", values[2]);
+    db_->ReleaseSnapshot(snapshot);
+
+    // Everything served from the tables.
+    dbfull()->TEST_CompactMemTable();
+    statuses = db_->MultiGet(ReadOptions(), keys, &values);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_EQ("va2", values[2]);
+    ASSERT_EQ("vc2", values[3]);
+    ASSERT_EQ("vb", values[4]);
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetMemUsage) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1014,6 +1256,56 @@ TEST_F(DBTest, IterMultiWithDeleteAndCompaction) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, IterBounds) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(Put("f", "vf"));
+    ASSERT_LEVELDB_OK(Put("g", "vg"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+
+    Slice lower("b");
+    Slice upper("f");
+    ReadOptions options;
+    options.iterate_lower_bound = &lower;
+    options.iterate_upper_bound = &upper;
+    Iterator* iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->SeekToLast();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "c->vc");
+    iter->Next();
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Prev();
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Prev();
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+
+    iter->Seek("a");
+    ASSERT_EQ(IterStatus(iter), "b->vb");
+    iter->Seek("cc");
+    ASSERT_EQ(IterStatus(iter), "d->vd");
+    iter->Seek("f");
+    ASSERT_EQ(IterStatus(iter), "(invalid)");
+    ASSERT_LEVELDB_OK(iter->status());
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, Recover) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1073,12 +1365,6 @@ TEST_F(DBTest, RecoverDuringMemtableCompaction) {
   } while (ChangeOptions());
 }
 
-static std::string Key(int i) {
-  char buf[100];
-  std::snprintf(buf, sizeof(buf), "key%06d", i);
-  return std::string(buf);
-}
-
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1104,6 +1390,118 @@ TEST_F(DBTest, MinorCompactionsHappen) {
   }
 }
 
+// Occupies a thread of the Env::kLow pool until released.
+struct LowPriorityBlocker {
+  port::Mutex mu;
+  port::CondVar cv{&mu};
+  bool running GUARDED_BY(mu) = false;
+  bool release GUARDED_BY(mu) = false;
+
+  static void Run(void* arg) {
+    LowPriorityBlocker* blocker = reinterpret_cast<LowPriorityBlocker*>(arg);
+    MutexLock l(&blocker->mu);
+    blocker->running = true;
+    blocker->cv.SignalAll();
+    while (!blocker->release) {
+      blocker->cv.Wait();
+    }
+    blocker->running = false;
+    blocker->cv.SignalAll();
+  }
+};
+
+TEST_F(DBTest, FlushWhileCompactionPoolIsBusy) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // Stand in for a long compaction that holds the only kLow thread.
+  LowPriorityBlocker blocker;
+  env_->ScheduleWithPriority(&LowPriorityBlocker::Run, &blocker, Env::kLow);
+  {
+    MutexLock l(&blocker.mu);
+    while (!blocker.running) {
+      blocker.cv.Wait();
+    }
+  }
+
+  // Memtable flushes run on the kHigh pool, so this does not wait for
+  // the blocker.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, TotalTableFiles());
+
+  {
+    MutexLock l(&blocker.mu);
+    blocker.release = true;
+    blocker.cv.SignalAll();
+    while (blocker.running) {
+      blocker.cv.Wait();
+    }
+  }
+  ASSERT_EQ("v1", Get("foo"));
+}
+
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 3;
+  env_->SetBackgroundThreads(3, Env::kLow);
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> values;
+  for (int i = 0; i < 3000; i++) {
+    const std::string key = Key(rnd.Uniform(1000));
+    values[key] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(key, values[key]));
+  }
+  for (const auto& kv : values) {
+    ASSERT_EQ(kv.second, Get(kv.first));
+  }
+
+  Reopen(&options);
+  for (const auto& kv : values) {
+    ASSERT_EQ(kv.second, Get(kv.first));
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_subcompactions = 4;
+  env_->SetBackgroundThreads(4, Env::kLow);
+  Reopen(&options);
+
+  Random rnd(301);
+  std::map<std::string, std::string> values;
+  for (int i = 0; i < 2000; i++) {
+    const std::string key = Key(rnd.Uniform(1000));
+    values[key] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(key, values[key]));
+  }
+  for (int i = 0; i < 1000; i += 7) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+    values.erase(Key(i));
+  }
+
+  // The level-0 files span the whole key range, so compacting them is
+  // split across several threads.
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  auto expected = values.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++expected) {
+    ASSERT_TRUE(expected != values.end());
+    ASSERT_EQ(expected->first, iter->key().ToString());
+    ASSERT_EQ(expected->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(expected == values.end());
+  delete iter;
+}
+
 TEST_F(DBTest, RecoverWithLargeLog) {
   {
     Options options = CurrentOptions();
@@ -1463,6 +1861,298 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
+
+    // Newer writes are not hidden by the tombstone.
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeInMemTableAfterReads) {
+  // Reads in between must not leave later tombstones unseen.
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vd", Get("d"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "c", "e"));
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  ASSERT_EQ("vd", Get("d", snapshot));
+  ASSERT_EQ("", Contents());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(i), Key(i + 1)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i)));
+  }
+  ASSERT_EQ("vd", Get("d", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, DeleteRangeAcrossLevels) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  // The tombstone lives in a newer file than the values it hides.
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ("vb", Get("b", snapshot));
+  ASSERT_EQ("(c->vc)(z->vz)", Contents());
+
+  // Compaction must keep the hidden values while the snapshot needs them.
+  Compact("a", "z");
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("vb", Get("b", snapshot));
+  ASSERT_EQ("[ vb ]", AllEntriesFor("b"));
+
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("(c->vc)(z->vz)", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  // Put a file at level 2 that will be entirely covered by a tombstone.
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "e"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("(a->va)", Contents());
+
+  Compact("a", "e");
+  ASSERT_EQ("(a->va)", Contents());
+  ASSERT_EQ("[ ]", AllEntriesFor("c"));
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ(1, TotalTableFiles());
+}
+
+TEST_F(DBTest, DeleteRangeInvalidArguments) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_TRUE(
+      db_->DeleteRange(WriteOptions(), "b", "a").IsInvalidArgument());
+  // An empty range deletes nothing.
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+  ASSERT_EQ("va", Get("a"));
+}
+
+TEST_F(DBTest, DeleteFilesInRange) {
+  const char* prefixes[] = {"a", "b", "c"};
+  for (const char* prefix : prefixes) {
+    ASSERT_LEVELDB_OK(Put(std::string(prefix) + "1", "v"));
+    ASSERT_LEVELDB_OK(Put(std::string(prefix) + "2", "v"));
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("0,0,3", FilesPerLevel());
+  ASSERT_LEVELDB_OK(Put("b3", "v"));  // Stays in the memtable
+
+  Slice begin("b"), end("bz");
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+  ASSERT_EQ("(a1->v)(a2->v)(b3->v)(c1->v)(c2->v)", Contents());
+
+  // Nothing left to delete in the range.
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("(b3->v)", Contents());
+
+  Reopen();
+  ASSERT_EQ("(b3->v)", Contents());
+}
+
+TEST_F(DBTest, DeleteFilesInRangeKeepsOlderValuesHidden) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("m", "old"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("m", "new"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // The level-1 file lies inside the range, but removing it would expose
+  // the older value of "m" held by the level-2 file.
+  Slice begin("l"), end("n");
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("new", Get("m"));
+
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+}
+
+// Build an external table in "fname" that maps each key of "entries" to its
+// value, or deletes it if the value is "DEL".
+static Status WriteExternalFile(
+    const Options& options, const std::string& fname,
+    const std::vector<std::pair<std::string, std::string>>& entries) {
+  SstFileWriter writer(options);
+  Status s = writer.Open(fname);
+  for (size_t i = 0; s.ok() && i < entries.size(); i++) {
+    if (entries[i].second == "DEL") {
+      s = writer.Delete(entries[i].first);
+    } else {
+      s = writer.Put(entries[i].first, entries[i].second);
+    }
+  }
+  if (s.ok()) {
+    s = writer.Finish();
+  }
+  return s;
+}
+
+TEST_F(DBTest, IngestExternalFile) {
+  do {
+    const std::string fname = dbname_ + "_external.ldb";
+    ASSERT_LEVELDB_OK(WriteExternalFile(
+        CurrentOptions(), fname,
+        {{"a", "va"}, {"b", "vb"}, {"c", "vc"}}));
+    ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+    ASSERT_FALSE(env_->FileExists(fname));
+
+    // Nothing else in the database: the file goes to the last level.
+    ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+    ASSERT_EQ(1, TotalTableFiles());
+    ASSERT_EQ("vb", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("bb"));
+    ASSERT_EQ("(a->va)(b->vb)(c->vc)", Contents());
+
+    ASSERT_LEVELDB_OK(Put("b", "vb2"));
+    ASSERT_EQ("vb2", Get("b"));
+    Reopen();
+    ASSERT_EQ("(a->va)(b->vb2)(c->vc)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, IngestExternalFileOverridesOlderData) {
+  ASSERT_LEVELDB_OK(Put("a", "old"));
+  ASSERT_LEVELDB_OK(Put("c", "old"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("b", "old"));  // Still in the memtable
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  const std::string fname = dbname_ + "_external.ldb";
+  ASSERT_LEVELDB_OK(WriteExternalFile(
+      CurrentOptions(), fname, {{"a", "DEL"}, {"b", "new"}, {"c", "new"}}));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  // The file overlaps the level-2 table, so it lands above it.
+  ASSERT_EQ(1, NumTableFilesAtLevel(1));
+
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("new", Get("b"));
+  ASSERT_EQ("new", Get("c"));
+  ASSERT_EQ("(b->new)(c->new)", Contents());
+  ASSERT_EQ("old", Get("a", snapshot));
+  ASSERT_EQ("old", Get("b", snapshot));
+  ASSERT_EQ("old", Get("c", snapshot));
+
+  Compact("a", "z");
+  ASSERT_EQ("(b->new)(c->new)", Contents());
+  ASSERT_EQ("old", Get("c", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("(b->new)(c->new)", Contents());
+  ASSERT_LEVELDB_OK(Put("c", "newer"));
+  ASSERT_EQ("newer", Get("c"));
+}
+
+TEST_F(DBTest, IngestExternalFileSurvivesRepair) {
+  ASSERT_LEVELDB_OK(Put("a", "old"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const std::string fname = dbname_ + "_external.ldb";
+  ASSERT_LEVELDB_OK(
+      WriteExternalFile(CurrentOptions(), fname, {{"a", "new"}}));
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+
+  // Repair places every table at level 0, where the sequence numbers
+  // alone decide which value of "a" wins.
+  Close();
+  ASSERT_LEVELDB_OK(RepairDB(dbname_, CurrentOptions()));
+  Reopen();
+  ASSERT_EQ("new", Get("a"));
+  ASSERT_EQ("(a->new)(b->vb)", Contents());
+  ASSERT_LEVELDB_OK(Put("a", "newer"));
+  ASSERT_EQ("newer", Get("a"));
+}
+
+TEST_F(DBTest, IngestExternalFileErrors) {
+  const std::string fname = dbname_ + "_external.ldb";
+  SstFileWriter writer(CurrentOptions());
+  ASSERT_LEVELDB_OK(writer.Open(fname));
+  ASSERT_LEVELDB_OK(writer.Put("b", "v"));
+  ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("b", "v").IsInvalidArgument());
+  ASSERT_LEVELDB_OK(writer.Finish());
+
+  ASSERT_FALSE(db_->IngestExternalFile(dbname_ + "_missing.ldb").ok());
+
+  // A table written by the database itself is refused and left in place.
+  ASSERT_LEVELDB_OK(Put("x", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  std::vector<std::string> children;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &children));
+  uint64_t number;
+  FileType type;
+  std::string table;
+  for (const std::string& child : children) {
+    if (ParseFileName(child, &number, &type) && type == kTableFile) {
+      table = dbname_ + "/" + child;
+    }
+  }
+  ASSERT_FALSE(table.empty());
+  const std::string copy = dbname_ + "_copy.ldb";
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, table, &contents));
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, contents, copy));
+  ASSERT_TRUE(db_->IngestExternalFile(copy).IsInvalidArgument());
+  ASSERT_TRUE(env_->FileExists(copy));
+  env_->RemoveFile(copy);
+
+  ASSERT_LEVELDB_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ("v", Get("b"));
+}
+
 TEST_F(DBTest, OverlapInLevel0) {
   do {
     ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
@@ -1977,10 +2667,586 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
-TEST_F(DBTest, LogCloseError) {
-  // Regression test for bug where we could ignore log file
-  // Close() error when switching to a new log file.
-  const int kValueSize = 20000;
+TEST_F(DBTest, FullFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewCacheLocalBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // The compacted table gets per-block filters, the newer one a full
+  // filter.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.full_filter = true;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "new"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 100 == 0 ? Key(i) + "new" : Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 3 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 5 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 512;
+  Reopen(&options);
+
+  // One table written with partitions, and a newer one without them
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.partition_index_and_filters = false;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i) + "new"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Every lookup in the partitioned table reads an index partition and a
+  // filter partition before the data block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 100 == 0 ? Key(i) + "new" : Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, 3 * N - 2 * N / 100);
+  ASSERT_LE(reads, 3 * N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 2 * N + 5 * N / 100);
+
+  // Iteration crosses the index partitions in both directions
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    count--;
+    ASSERT_EQ(Key(count), iter->key().ToString());
+  }
+  ASSERT_EQ(0, count);
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  for (bool partitioned : {false, true}) {
+    env_->count_random_reads_ = true;
+    env_->copy_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.create_if_missing = true;
+    options.block_cache = NewLRUCache(1 << 20, 0.5);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.cache_index_and_filter_blocks = true;
+    options.partition_index_and_filters = partitioned;
+    DestroyAndReopen(&options);
+
+    // About twice as much data as the block cache holds
+    const int N = 2000;
+    const std::string value(1000, 'x');
+    for (int i = 0; i < N; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), value));
+    }
+    Compact("a", "z");
+    Reopen(&options);
+    options.block_cache->Prune();
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+
+    // Opening the table charges its index and filter to the block cache,
+    // even for reads that do not fill it.
+    ReadOptions no_fill;
+    no_fill.fill_cache = false;
+    std::string result;
+    ASSERT_LEVELDB_OK(db_->Get(no_fill, Key(0), &result));
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+    ASSERT_LT(options.block_cache->TotalCharge(), 64 << 10);
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+
+    // Data blocks churning through the cache leave the index and filter
+    // blocks in place, so missing keys are answered without reads.
+    int reads = 0;
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      if (i % 100 == 0) {
+        reads += env_->random_read_counter_.Read();
+        Iterator* iter = db_->NewIterator(ReadOptions());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          count++;
+        }
+        ASSERT_EQ(N, count);
+        delete iter;
+        env_->random_read_counter_.Reset();
+      }
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    reads += env_->random_read_counter_.Read();
+    std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+    ASSERT_LE(reads, N / 80);
+
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
+TEST_F(DBTest, RowCache) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent block cache hits
+  options.row_cache = NewLRUCache(1 << 20);
+  Reopen(&options);
+
+  const int N = 100;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // The second round of lookups is answered by the row cache
+  for (int round = 0; round < 2; round++) {
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    const int reads = env_->random_read_counter_.Read();
+    if (round == 0) {
+      ASSERT_GE(reads, N);
+    } else {
+      ASSERT_EQ(0, reads);
+    }
+  }
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Rows are only used by lookups that are not older than them
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put(Key(0), "new"));
+  ASSERT_LEVELDB_OK(Delete(Key(1)));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(2), Key(4)));
+  dbfull()->TEST_CompactMemTable();
+  for (int pass = 0; pass < 2; pass++) {
+    for (int round = 0; round < 2; round++) {
+      ASSERT_EQ("new", Get(Key(0)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(1)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(2)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(3)));
+      ASSERT_EQ(Key(4), Get(Key(4)));
+      for (int i = 0; i < 5; i++) {
+        ASSERT_EQ(Key(i), Get(Key(i), snapshot));
+      }
+    }
+    // Both versions now live in the same file
+    Compact("a", "z");
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  Close();
+  delete options.block_cache;
+  delete options.row_cache;
+}
+
+TEST_F(DBTest, MultiGetBatchesBlockReads) {
+  env_->count_random_reads_ = true;
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Many data blocks in one table, plus a newer table the keys are
+  // checked against first.
+  const int N = 200;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  Compact(Key(0), Key(N));
+  ASSERT_LEVELDB_OK(Put(Key(N), "newer"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("newer", Get(Key(N)));  // Opens both tables
+
+  std::vector<std::string> key_strings;
+  for (int i = 0; i < N; i += 2) {
+    key_strings.push_back(Key(i));
+  }
+  std::vector<Slice> keys(key_strings.begin(), key_strings.end());
+  std::vector<std::string> values;
+  env_->random_read_counter_.Reset();
+  std::vector<Status> statuses = db_->MultiGet(ReadOptions(), keys, &values);
+  const int reads = env_->random_read_counter_.Read();
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_LEVELDB_OK(statuses[i]);
+    ASSERT_EQ(std::string(1000, 'a' + (2 * i) % 26), values[i]);
+  }
+  // One batch instead of a read per data block.
+  ASSERT_LE(reads, 2);
+
+  Close();
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, IteratorsReadAhead) {
+  env_->count_random_reads_ = true;
+  env_->copy_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  // About 50 data blocks in one table.
+  const int N = 200;
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < N; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(values[0], Get(Key(0)));  // Opens the table
+
+  // Scans with a fresh block cache, so that every data block is read
+  // from the file.  Returns the number of reads it issued.
+  auto scan = [&](const ReadOptions& read_options) {
+    options.block_cache = NewLRUCache(8 << 20);
+    Reopen(&options);
+    EXPECT_EQ(values[0], Get(Key(0)));
+    env_->random_read_counter_.Reset();
+    Iterator* iter = db_->NewIterator(read_options);
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      EXPECT_EQ(values[i], iter->value().ToString());
+    }
+    EXPECT_LEVELDB_OK(iter->status());
+    EXPECT_EQ(N, i);
+    delete iter;
+    const int reads = env_->random_read_counter_.Read();
+    Close();
+    delete options.block_cache;
+    options.block_cache = nullptr;
+    return reads;
+  };
+
+  // Windows of 8KB, 16KB, ... after two reads of single blocks.
+  ASSERT_LE(scan(ReadOptions()), 10);
+
+  ReadOptions read_options;
+  read_options.readahead_size = 1 << 20;
+  ASSERT_LE(scan(read_options), 2);
+
+  // Compaction inputs are read in windows of compaction_readahead_size.
+  // A second table that overlaps the first keeps the compaction from
+  // moving the first one down as it is.
+  Reopen(&options);
+  values[0] = "newer";
+  ASSERT_LEVELDB_OK(Put(Key(0), values[0]));
+  values[N - 1] = "newer";
+  ASSERT_LEVELDB_OK(Put(Key(N - 1), values[N - 1]));
+  dbfull()->TEST_CompactMemTable();
+  env_->random_read_counter_.Reset();
+  Compact(Key(0), Key(N));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  // Footer, metaindex and index blocks, and one window for the data
+  // blocks of each table.
+  ASSERT_LE(env_->random_read_counter_.Read(), 8);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, DirectIO) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.use_direct_reads = true;
+  options.use_direct_io_for_flush_and_compaction = true;
+  options.block_cache = NewLRUCache(1 << 20);
+  FillCompactAndScan(&options);
+
+  // Every table was written and read with direct I/O.
+  ASSERT_GT(env_->direct_writes_opened_.Read(), 0);
+  ASSERT_GT(env_->direct_reads_opened_.Read(), 0);
+  ASSERT_EQ(0, env_->mmap_reads_opened_.Read());
+  ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, DirectIONotSupported) {
+  env_->no_direct_io_.store(true, std::memory_order_release);
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.create_if_missing = true;
+
+  // Flushes fail and name the option that asked for direct I/O.
+  options.use_direct_io_for_flush_and_compaction = true;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Status s = dbfull()->TEST_CompactMemTable();
+  ASSERT_TRUE(s.IsNotSupportedError());
+  ASSERT_NE(std::string::npos,
+            s.ToString().find("use_direct_io_for_flush_and_compaction"));
+
+  // So do reads of table files.
+  options.use_direct_io_for_flush_and_compaction = false;
+  DestroyAndReopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  options.use_direct_reads = true;
+  Reopen(&options);
+  std::string result = Get("foo");
+  ASSERT_NE(std::string::npos, result.find("Not implemented"));
+  ASSERT_NE(std::string::npos, result.find("use_direct_reads"));
+
+  Close();
+  env_->no_direct_io_.store(false, std::memory_order_release);
+}
+
+TEST_F(DBTest, MmapReads) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.use_mmap_reads = true;
+  options.compression = kNoCompression;
+  options.block_cache = NewLRUCache(1 << 20);
+  FillCompactAndScan(&options);
+
+  ASSERT_GT(env_->mmap_reads_opened_.Read(), 0);
+  ASSERT_EQ(0, env_->direct_reads_opened_.Read());
+  ASSERT_EQ(0, env_->direct_writes_opened_.Read());
+  // The blocks were read in place rather than copied into the cache.
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, DataBlockHashIndex) {
+  Options options = CurrentOptions();
+  options.data_block_hash_index = true;
+  Reopen(&options);
+
+  // Several versions of some keys, in a table written with the index and
+  // a newer one written without it.  Flushes keep every version.
+  const int N = 2000;
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v1"));
+  }
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v2"));
+    if (i % 10 == 0) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  options.data_block_hash_index = false;
+  Reopen(&options);
+  for (int i = 1; i < N; i += 4) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v3"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  options.data_block_hash_index = true;
+  Reopen(&options);
+
+  for (int i = 0; i < N; i++) {
+    std::string expected = "NOT_FOUND";
+    if (i % 4 == 1) {
+      expected = "v3";
+    } else if (i % 2 == 0 && i % 10 != 0) {
+      expected = "v2";
+    }
+    ASSERT_EQ(expected, Get(Key(i))) << i;
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+
+  // Compaction rewrites both tables with the index
+  Compact(Key(0), Key(N));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Put(Key(2), "v4"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v2", Get(Key(2), snapshot));
+  ASSERT_EQ("v4", Get(Key(2)));
+  ASSERT_EQ("v3", Get(Key(N - 3)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(N - 2) + ".missing"));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Only even prefixes are present: "k000/0".."k000/9", "k002/0", ...
+  std::string value(100, 'v');
+  for (int i = 0; i < 200; i += 2) {
+    for (int j = 0; j < 10; j++) {
+      char key[100];
+      std::snprintf(key, sizeof(key), "k%03d/%d", i, j);
+      ASSERT_LEVELDB_OK(Put(key, value));
+    }
+  }
+  Compact("a", "z");
+  ASSERT_LEVELDB_OK(Put("k050/x", "mem"));
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(read_options);
+  iter->Seek("k050/5");
+  ASSERT_EQ(IterStatus(iter), "k050/5->" + value);
+  int count = 0;
+  for (; iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(iter->key().starts_with("k050"));
+    count++;
+  }
+  ASSERT_EQ(6, count);  // "k050/5".."k050/9" and "k050/x"
+
+  // Targets shorter than the prefix are not restricted.
+  iter->Seek("k");
+  ASSERT_EQ(IterStatus(iter), "k000/0->" + value);
+
+  // Missing prefixes are ruled out by the filters without reading data.
+  env_->random_read_counter_.Reset();
+  for (int i = 1; i < 200; i += 2) {
+    char key[100];
+    std::snprintf(key, sizeof(key), "k%03d", i);
+    iter->Seek(key);
+    ASSERT_FALSE(iter->Valid());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "100 missing prefixes => %d reads\n", reads);
+  ASSERT_LE(reads, 10);
+  ASSERT_LEVELDB_OK(iter->status());
+
+  iter->SeekToLast();
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, IterUpperBoundStopsBeforeDeletions) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  Reopen(&options);
+
+  const int N = 1000;
+  std::string value(1000, 'v');
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), value));
+  }
+  Compact("a", "z");
+  for (int i = 100; i < N; i++) {
+    ASSERT_LEVELDB_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Without a bound, the scan reads every deleted entry looking for the
+  // next live one.
+  env_->random_read_counter_.Reset();
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  delete iter;
+  const int unbounded_reads = env_->random_read_counter_.Read();
+
+  const std::string limit = Key(100);
+  Slice upper(limit);
+  ReadOptions read_options;
+  read_options.iterate_upper_bound = &upper;
+  env_->random_read_counter_.Reset();
+  iter = db_->NewIterator(read_options);
+  count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(100, count);
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  const int bounded_reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "unbounded => %d reads, bounded => %d reads\n",
+               unbounded_reads, bounded_reads);
+  ASSERT_LE(bounded_reads * 4, unbounded_reads);
+
+  Close();
+  delete options.block_cache;
+}
+
+TEST_F(DBTest, LogCloseError) {
+  // Regression test for bug where we could ignore log file
+  // Close() error when switching to a new log file.
+  const int kValueSize = 20000;
   const int kWriteCount = 10;
   const int kWriteBufferSize = (kValueSize * kWriteCount) / 2;
 
@@ -2004,6 +3270,39 @@ TEST_F(DBTest, LogCloseError) {
   env_->log_file_close_.store(false, std::memory_order_release);
 }
 
+TEST_F(DBTest, ReadsFollowSuperVersionChanges) {
+  do {
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+    ASSERT_EQ("v1", Get("foo"));  // Caches the state on this thread
+    Iterator* iter = db_->NewIterator(ReadOptions());
+
+    // Switching the memtable and installing new versions must not leave
+    // reads on stale state.
+    ASSERT_LEVELDB_OK(Put("foo", "v2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_LEVELDB_OK(Put("bar", "v3"));
+    ASSERT_EQ("v3", Get("bar"));
+    Compact("a", "z");
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("v3", Get("bar"));
+    std::thread other([this]() {
+      ASSERT_EQ("v2", Get("foo"));
+      ASSERT_EQ("v3", Get("bar"));
+    });
+    other.join();
+
+    // The iterator keeps the memtable it was created on alive.
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("foo", iter->key().ToString());
+    ASSERT_EQ("v1", iter->value().ToString());
+    iter->Next();
+    ASSERT_TRUE(!iter->Valid());
+    delete iter;
+  } while (ChangeOptions());
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2120,6 +3419,12 @@ class ModelDB : public DB {
   Status Delete(const WriteOptions& o, const Slice& key) override {
     return DB::Delete(o, key);
   }
+  Status DeleteRange(const WriteOptions& o, const Slice& begin_key,
+                     const Slice& end_key) override {
+    WriteBatch batch;
+    batch.DeleteRange(begin_key, end_key);
+    return Write(o, &batch);
+  }
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override {
     assert(false);  // Not implemented
@@ -2153,6 +3458,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+        if (begin_key.compare(end_key) < 0) {
+          map_->erase(map_->lower_bound(begin_key.ToString()),
+                      map_->lower_bound(end_key.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2168,6 +3479,9 @@ class ModelDB : public DB {
     }
   }
   void CompactRange(const Slice* start, const Slice* end) override {}
+  Status DeleteFilesInRange(const Slice* begin, const Slice* end) override {
+    return Status::OK();
+  }
 
  private:
   class ModelIter : public Iterator {
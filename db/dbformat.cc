@@ -114,6 +114,20 @@ bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+const char* InternalKeySliceTransform::Name() const {
+  return user_transform_->Name();
+}
+
+Slice InternalKeySliceTransform::Transform(const Slice& key) const {
+  Slice prefix = user_transform_->Transform(ExtractUserKey(key));
+  assert(prefix.data() == key.data());
+  return Slice(key.data(), prefix.size() + 8);
+}
+
+bool InternalKeySliceTransform::InDomain(const Slice& key) const {
+  return user_transform_->InDomain(ExtractUserKey(key));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
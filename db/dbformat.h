@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -51,14 +52,20 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  // Start key of a range tombstone.  Only found in write batches, in the
+  // range deletion part of memtables and sstables, and in file boundaries.
+  kTypeRangeDeletion = 0x2
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 typedef uint64_t SequenceNumber;
 
@@ -128,6 +135,23 @@ class InternalFilterPolicy : public FilterPolicy {
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
+// Prefix extractor wrapper that applies a user prefix extractor to the
+// user key of an internal key.  Transform() keeps eight bytes after the
+// user key prefix so that the result can be passed to an
+// InternalFilterPolicy, which strips them again.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const SliceTransform* user_transform() const { return user_transform_; }
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -177,7 +201,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeRangeDeletion));
 }
 
 // A helper class useful for DBImpl::Get()
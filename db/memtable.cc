@@ -8,6 +8,7 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,11 +20,23 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_deletions_(0),
+      range_dels_count_(0) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  size_t usage = arena_.MemoryUsage();
+  for (InsertSlot& slot : slots_) {
+    // Arena::MemoryUsage() is safe to call without the slot's lock.
+    usage += slot.arena.MemoryUsage();
+  }
+  return usage;
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr,
                                         const char* bptr) const {
@@ -73,8 +86,37 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  if (num_range_deletions_.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  return new MemTableIterator(&range_del_table_);
+}
+
+std::shared_ptr<const RangeTombstoneList> MemTable::GetRangeTombstones() {
+  // Every tombstone counted here is already in range_del_table_, and the
+  // tombstones of a published sequence number were counted before it
+  // was published.
+  const int count = num_range_deletions_.load(std::memory_order_acquire);
+  if (count == 0) {
+    return nullptr;
+  }
+  MutexLock l(&range_dels_mu_);
+  if (range_dels_count_ != count) {
+    RangeTombstoneList* list =
+        new RangeTombstoneList(comparator_.comparator.user_comparator());
+    MemTableIterator iter(&range_del_table_);
+    Status s = list->AddAll(&iter);
+    assert(s.ok());  // Only Add() puts range tombstones in the table
+    list->Finish();
+    range_dels_.reset(list);
+    range_dels_count_ = count;
+  }
+  return range_dels_;
+}
+
+char* MemTable::EncodeEntry(Arena* arena, SequenceNumber s, ValueType type,
+                            const Slice& key, const Slice& value) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -87,7 +129,7 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = arena->Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -96,11 +138,48 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  return buf;
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+  char* buf = EncodeEntry(&arena_, s, type, key, value);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+    num_range_deletions_.fetch_add(1, std::memory_order_release);
+  } else {
+    table_.Insert(buf);
+  }
+}
+
+void MemTable::AddConcurrently(int slot, SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  InsertSlot* insert_slot = &slots_[slot % kNumInsertSlots];
+  MutexLock l(&insert_slot->mu);
+  char* buf = EncodeEntry(&insert_slot->arena, s, type, key, value);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.InsertConcurrently(buf, &insert_slot->arena,
+                                        &insert_slot->rnd);
+    num_range_deletions_.fetch_add(1, std::memory_order_release);
+  } else {
+    table_.InsertConcurrently(buf, &insert_slot->arena, &insert_slot->rnd);
+  }
+}
+
+SequenceNumber MemTable::MaxCoveringTombstoneSeq(const Slice& user_key,
+                                                 SequenceNumber snapshot) {
+  std::shared_ptr<const RangeTombstoneList> range_dels = GetRangeTombstones();
+  if (range_dels == nullptr) {
+    return 0;
+  }
+  return range_dels->MaxCoveringSeq(user_key, snapshot);
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   Slice memkey = key.memtable_key();
+  Slice ikey = key.internal_key();
+  const SequenceNumber tombstone_seq = MaxCoveringTombstoneSeq(
+      key.user_key(), DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
   if (iter.Valid()) {
@@ -120,6 +199,11 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
             Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < tombstone_seq) {
+        // Deleted by a newer range tombstone
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
@@ -127,11 +211,17 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
           return true;
         }
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *s = Status::NotFound(Slice());
           return true;
       }
     }
   }
+  if (tombstone_seq > 0) {
+    // No entry for the key, but older ones elsewhere are deleted
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
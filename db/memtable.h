@@ -5,12 +5,18 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -50,14 +56,36 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable, or
+  // nullptr if there are none.  Keys are internal keys of the tombstone
+  // begin keys and values are the (exclusive) end keys.  The same
+  // lifetime rules as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
+  // Return the range tombstones in the memtable, fragmented for lookups,
+  // or nullptr if there are none.  The list is built on the first call
+  // and rebuilt only after more tombstones are added.  It includes every
+  // tombstone whose sequence number was published before the call.
+  std::shared_ptr<const RangeTombstoneList> GetRangeTombstones();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  If
+  // type==kTypeRangeDeletion, key and value are the begin and end
+  // of the deleted range.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may run in parallel with other AddConcurrently()
+  // calls.  Callers that pass distinct values of "slot" allocate from
+  // distinct arenas and do not contend with each other.
+  // REQUIRES: no concurrent call to Add().
+  void AddConcurrently(int slot, SequenceNumber seq, ValueType type,
+                       const Slice& key, const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
+  // If memtable contains a deletion for key, or a range tombstone that
+  // covers it and is newer than its value, store a NotFound() error
   // in *status and return true.
   // Else, return false.
   bool Get(const LookupKey& key, std::string* value, Status* s);
@@ -74,12 +102,43 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // Allocation state for the AddConcurrently() callers that share a slot.
+  struct InsertSlot {
+    InsertSlot() : rnd(0xdeadbeef) {}
+
+    port::Mutex mu;
+    Arena arena;  // Allocations require mu; MemoryUsage() does not
+
+    Random rnd GUARDED_BY(mu);
+  };
+
+  enum { kNumInsertSlots = 16 };
+
+  // Encode an entry into "*arena" and return it.
+  static char* EncodeEntry(Arena* arena, SequenceNumber seq, ValueType type,
+                           const Slice& key, const Slice& value);
+
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  // Return the largest sequence number <= snapshot of a range tombstone
+  // covering user_key, or zero if there is none.
+  SequenceNumber MaxCoveringTombstoneSeq(const Slice& user_key,
+                                         SequenceNumber snapshot);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, kept apart from table_
+  std::atomic<int> num_range_deletions_;  // Entries in range_del_table_
+  InsertSlot slots_[kNumInsertSlots];
+
+  // Cache of GetRangeTombstones(), built from the first
+  // range_dels_count_ entries of range_del_table_.
+  port::Mutex range_dels_mu_;
+  std::shared_ptr<const RangeTombstoneList> range_dels_
+      GUARDED_BY(range_dels_mu_);
+  int range_dels_count_ GUARDED_BY(range_dels_mu_);
 };
 
 }  // namespace leveldb
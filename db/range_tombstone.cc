@@ -0,0 +1,137 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator), finished_(false) {}
+
+RangeTombstoneList::~RangeTombstoneList() = default;
+
+void RangeTombstoneList::Add(const Slice& begin, const Slice& end,
+                             SequenceNumber seq) {
+  assert(!finished_);
+  if (ucmp_->Compare(begin, end) >= 0) {
+    return;
+  }
+  RangeTombstone t;
+  t.begin = begin.ToString();
+  t.end = end.ToString();
+  t.seq = seq;
+  tombstones_.push_back(t);
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  ParsedInternalKey ikey;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  const Comparator* ucmp = ucmp_;
+  auto less = [ucmp](const Slice& a, const Slice& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+
+  // Every begin and end key is a fragment boundary.
+  std::vector<Slice> points;
+  points.reserve(2 * tombstones_.size());
+  std::vector<const RangeTombstone*> by_begin;
+  by_begin.reserve(tombstones_.size());
+  for (const RangeTombstone& t : tombstones_) {
+    points.push_back(t.begin);
+    points.push_back(t.end);
+    by_begin.push_back(&t);
+  }
+  std::sort(points.begin(), points.end(), less);
+  points.erase(std::unique(points.begin(), points.end(),
+                           [ucmp](const Slice& a, const Slice& b) {
+                             return ucmp->Compare(a, b) == 0;
+                           }),
+               points.end());
+  std::sort(by_begin.begin(), by_begin.end(),
+            [ucmp](const RangeTombstone* a, const RangeTombstone* b) {
+              return ucmp->Compare(a->begin, b->begin) < 0;
+            });
+
+  // Sweep the boundaries, keeping the tombstones that cover the current
+  // piece in "active".
+  std::vector<const RangeTombstone*> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    const Slice& p = points[i];
+    while (next < by_begin.size() &&
+           ucmp->Compare(by_begin[next]->begin, p) <= 0) {
+      active.push_back(by_begin[next++]);
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [ucmp, &p](const RangeTombstone* t) {
+                                  return ucmp->Compare(t->end, p) <= 0;
+                                }),
+                 active.end());
+    if (active.empty()) {
+      continue;
+    }
+    Fragment f;
+    f.begin = p;
+    f.end = points[i + 1];
+    for (const RangeTombstone* t : active) {
+      f.seqs.push_back(t->seq);
+    }
+    std::sort(f.seqs.begin(), f.seqs.end(),
+              [](SequenceNumber a, SequenceNumber b) { return a > b; });
+    f.seqs.erase(std::unique(f.seqs.begin(), f.seqs.end()), f.seqs.end());
+    fragments_.push_back(f);
+  }
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSeq(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(finished_);
+  // Find the last fragment whose begin is <= user_key.
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0) {
+    return 0;
+  }
+  const Fragment& f = fragments_[left - 1];
+  if (ucmp_->Compare(user_key, f.end) >= 0) {
+    return 0;
+  }
+  for (SequenceNumber seq : f.seqs) {
+    if (seq <= snapshot) {
+      return seq;
+    }
+  }
+  return 0;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+// A range tombstone deletes every entry whose user key is in [begin, end)
+// and whose sequence number is smaller than seq.
+struct RangeTombstone {
+  std::string begin;
+  std::string end;
+  SequenceNumber seq;
+};
+
+// A RangeTombstoneList answers "what is the newest tombstone covering this
+// user key" for a fixed set of range tombstones.  Tombstones are collected
+// with Add() and then split into non-overlapping fragments by Finish(), so
+// that a lookup is a binary search over the fragments.
+//
+// A RangeTombstoneList is not thread-safe while it is being built, but
+// concurrent lookups after Finish() are safe.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  ~RangeTombstoneList();
+
+  // Add a tombstone for [begin, end) at sequence number seq.  Empty
+  // ranges are ignored.
+  // REQUIRES: Finish() has not been called.
+  void Add(const Slice& begin, const Slice& end, SequenceNumber seq);
+
+  // Add every tombstone yielded by "iter", whose keys are internal keys
+  // of tombstone begin keys and whose values are the end keys.
+  // REQUIRES: Finish() has not been called.
+  Status AddAll(Iterator* iter);
+
+  // Build the fragments used by MaxCoveringSeq().
+  void Finish();
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // The tombstones added so far, in the order they were added.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Return the largest sequence number <= snapshot of a tombstone covering
+  // user_key, or zero if there is no such tombstone.
+  // REQUIRES: Finish() has been called.
+  SequenceNumber MaxCoveringSeq(const Slice& user_key,
+                                SequenceNumber snapshot) const;
+
+ private:
+  // A piece [begin, end) of the key space covered by the same tombstones.
+  struct Fragment {
+    Slice begin;
+    Slice end;
+    std::vector<SequenceNumber> seqs;  // Decreasing
+  };
+
+  const Comparator* const ucmp_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;  // Sorted by begin, non-overlapping
+  bool finished_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
@@ -14,6 +14,8 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - tables added by DB::IngestExternalFile() keep the global
+//        sequence number recorded for them by the old descriptors
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,6 +26,8 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -31,6 +35,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -49,7 +54,9 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        iprefix_(options.prefix_extractor),
+        options_(
+            SanitizeOptions(dbname, &icmp_, &ipolicy_, &iprefix_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -70,6 +77,7 @@ class Repairer {
   Status Run() {
     Status status = FindFiles();
     if (status.ok()) {
+      ReadGlobalSequences();
       ConvertLogFilesToTables();
       ExtractMetaData();
       status = WriteDescriptor();
@@ -128,6 +136,51 @@ class Repairer {
     return status;
   }
 
+  // Collect the global sequence numbers of ingested tables from the old
+  // descriptors.  They are only recorded there, and the tables themselves
+  // store sequence number zero for every entry.
+  void ReadGlobalSequences() {
+    struct DescriptorReporter : public log::Reader::Reporter {
+      Logger* info_log;
+      const std::string* fname;
+      void Corruption(size_t bytes, const Status& s) override {
+        Log(info_log, "%s: dropping %d bytes; %s", fname->c_str(),
+            static_cast<int>(bytes), s.ToString().c_str());
+      }
+    };
+
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      const std::string fname = dbname_ + "/" + manifests_[i];
+      SequentialFile* file;
+      Status status = env_->NewSequentialFile(fname, &file);
+      if (!status.ok()) {
+        Log(options_.info_log, "%s: ignoring %s", fname.c_str(),
+            status.ToString().c_str());
+        continue;
+      }
+      DescriptorReporter reporter;
+      reporter.info_log = options_.info_log;
+      reporter.fname = &fname;
+      log::Reader reader(file, &reporter, true /*checksum*/,
+                         0 /*initial_offset*/);
+      Slice record;
+      std::string scratch;
+      while (reader.ReadRecord(&record, &scratch)) {
+        VersionEdit edit;
+        if (!edit.DecodeFrom(record).ok()) {
+          continue;
+        }
+        for (const auto& new_file : edit.new_files()) {
+          const FileMetaData& f = new_file.second;
+          if (f.global_sequence != 0) {
+            global_sequences_[f.number] = f.global_sequence;
+          }
+        }
+      }
+      delete file;
+    }
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
       std::string logname = LogFileName(dbname_, logs_[i]);
@@ -203,8 +256,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -229,12 +285,18 @@ class Repairer {
     // on checksum verification.
     ReadOptions r;
     r.verify_checksums = options_.paranoid_checks;
-    return table_cache_->NewIterator(r, meta.number, meta.file_size);
+    return table_cache_->NewIterator(r, meta.number, meta.file_size,
+                                     meta.global_sequence);
   }
 
   void ScanTable(uint64_t number) {
     TableInfo t;
     t.meta.number = number;
+    std::map<uint64_t, SequenceNumber>::const_iterator global =
+        global_sequences_.find(number);
+    if (global != global_sequences_.end()) {
+      t.meta.global_sequence = global->second;
+    }
     std::string fname = TableFileName(dbname_, number);
     Status status = env_->GetFileSize(fname, &t.meta.file_size);
     if (!status.ok()) {
@@ -281,6 +343,29 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Range tombstones widen the key range of the table.
+    RangeTombstoneList range_dels(icmp_.user_comparator());
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(
+          t.meta.number, t.meta.file_size, &range_dels);
+    }
+    for (const RangeTombstone& tombstone : range_dels.tombstones()) {
+      InternalKey smallest(tombstone.begin, tombstone.seq, kTypeRangeDeletion);
+      InternalKey largest(tombstone.end, kMaxSequenceNumber,
+                          kTypeRangeDeletion);
+      if (empty || icmp_.Compare(smallest, t.meta.smallest) < 0) {
+        t.meta.smallest = smallest;
+      }
+      if (empty || icmp_.Compare(largest, t.meta.largest) > 0) {
+        t.meta.largest = largest;
+      }
+      empty = false;
+      if (tombstone.seq > t.max_sequence) {
+        t.max_sequence = tombstone.seq;
+      }
+      t.meta.has_range_deletions = true;
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +397,8 @@ class Repairer {
       counter++;
     }
     delete iter;
+    // The copy stores the global sequence number in every entry.
+    t.meta.global_sequence = 0;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -367,9 +454,7 @@ class Repairer {
 
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
-      const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      edit_.AddFile(0, tables_[i].meta);
     }
 
     // std::fprintf(stderr,
@@ -429,6 +514,7 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  InternalKeySliceTransform const iprefix_;
   const Options options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -439,6 +525,7 @@ class Repairer {
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
+  std::map<uint64_t, SequenceNumber> global_sequences_;  // By table number
   uint64_t next_file_number_;
 };
 }  // namespace
@@ -8,7 +8,9 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Writes require external synchronization, most likely a mutex.  The one
+// exception is InsertConcurrently(), which may run in parallel with other
+// InsertConcurrently() calls (but not with Insert()).
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -54,6 +56,14 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but safe to call concurrently with other calls to
+  // InsertConcurrently().  The node is allocated from "*arena" and its
+  // height drawn from "*rnd"; neither may be used by another thread for
+  // the duration of the call, and "*arena" must outlive the list.
+  // REQUIRES: no concurrent call to Insert().
+  // REQUIRES: nothing that compares equal to key is currently in the list.
+  void InsertConcurrently(const Key& key, Arena* arena, Random* rnd);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -103,8 +113,8 @@ class SkipList {
     return max_height_.load(std::memory_order_relaxed);
   }
 
-  Node* NewNode(const Key& key, int height);
-  int RandomHeight();
+  Node* NewNode(const Key& key, int height, Arena* arena);
+  int RandomHeight(Random* rnd);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -125,14 +135,19 @@ class SkipList {
   // Return head_ if list is empty.
   Node* FindLast() const;
 
+  // Starting at "before", whose key is less than key, find the adjacent
+  // pair of nodes at "level" that key belongs between.
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** out_prev, Node** out_next) const;
+
   // Immutable after construction
   Comparator const compare_;
   Arena* const arena_;  // Arena used for allocations of nodes
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   std::atomic<int> max_height_;  // Height of the entire list
 
   // Read/written only by Insert().
@@ -171,6 +186,15 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Atomically replace the link "expected" with "x".  Returns false if
+  // the link no longer points at "expected".
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
@@ -178,8 +202,8 @@ struct SkipList<Key, Comparator>::Node {
 
 template <typename Key, class Comparator>
 typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
-    const Key& key, int height) {
-  char* const node_memory = arena_->AllocateAligned(
+    const Key& key, int height, Arena* arena) {
+  char* const node_memory = arena->AllocateAligned(
       sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
   return new (node_memory) Node(key);
 }
@@ -237,11 +261,11 @@ inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
 }
 
 template <typename Key, class Comparator>
-int SkipList<Key, Comparator>::RandomHeight() {
+int SkipList<Key, Comparator>::RandomHeight(Random* rnd) {
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  while (height < kMaxHeight && rnd_.OneIn(kBranching)) {
+  while (height < kMaxHeight && rnd->OneIn(kBranching)) {
     height++;
   }
   assert(height > 0);
@@ -319,11 +343,28 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::FindSpliceForLevel(const Key& key,
+                                                   Node* before, int level,
+                                                   Node** out_prev,
+                                                   Node** out_next) const {
+  while (true) {
+    Node* next = before->Next(level);
+    if (KeyIsAfterNode(key, next)) {
+      before = next;
+    } else {
+      *out_prev = before;
+      *out_next = next;
+      return;
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
     : compare_(cmp),
       arena_(arena),
-      head_(NewNode(0 /* any key will do */, kMaxHeight)),
+      head_(NewNode(0 /* any key will do */, kMaxHeight, arena)),
       max_height_(1),
       rnd_(0xdeadbeef) {
   for (int i = 0; i < kMaxHeight; i++) {
@@ -341,7 +382,7 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   // Our data structure does not allow duplicate insertion
   assert(x == nullptr || !Equal(key, x->key));
 
-  int height = RandomHeight();
+  int height = RandomHeight(&rnd_);
   if (height > GetMaxHeight()) {
     for (int i = GetMaxHeight(); i < height; i++) {
       prev[i] = head_;
@@ -356,7 +397,7 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
     max_height_.store(height, std::memory_order_relaxed);
   }
 
-  x = NewNode(key, height);
+  x = NewNode(key, height, arena_);
   for (int i = 0; i < height; i++) {
     // NoBarrier_SetNext() suffices since we will add a barrier when
     // we publish a pointer to "x" in prev[i].
@@ -365,6 +406,50 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
+template <typename Key, class Comparator>
+void SkipList<Key, Comparator>::InsertConcurrently(const Key& key,
+                                                   Arena* arena, Random* rnd) {
+  const int height = RandomHeight(rnd);
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    // See Insert() for why readers tolerate a max_height_ that runs ahead
+    // of the links from head_.
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      max_height = height;
+    }
+  }
+
+  // Find the splice at every level, top down, reusing the predecessor
+  // found at one level as the starting point for the level below.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int i = max_height - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+    before = prev[i];
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  // Link bottom up so that a reader that finds the node at some level can
+  // always continue its search at the levels below.  If another inserter
+  // slipped in between prev[i] and next[i], recompute the splice at that
+  // level starting from prev[i], which still precedes key since nodes are
+  // never removed.
+  Node* x = NewNode(key, height, arena);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
 template <typename Key, class Comparator>
 bool SkipList<Key, Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
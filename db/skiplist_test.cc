@@ -13,6 +13,7 @@
 #include "port/thread_annotations.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -365,4 +366,83 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads calling InsertConcurrently() on the same list, each
+// with its own arena and random number generator.
+class ConcurrentInsertState {
+ public:
+  static constexpr int kThreads = 4;
+  static constexpr int kPerThread = 20000;
+
+  ConcurrentInsertState() : list_(Comparator(), &arena_), cv_(&mu_) {}
+
+  void Insert(int id) {
+    Arena* arena = &thread_arenas_[id];
+    Random rnd(1000 + id);
+    for (int i = 0; i < kPerThread; i++) {
+      list_.InsertConcurrently(static_cast<Key>(i) * kThreads + id, arena,
+                               &rnd);
+    }
+    MutexLock l(&mu_);
+    done_++;
+    cv_.SignalAll();
+  }
+
+  void WaitForThreads() {
+    MutexLock l(&mu_);
+    while (done_ < kThreads) {
+      cv_.Wait();
+    }
+  }
+
+  SkipList<Key, Comparator>* list() { return &list_; }
+
+ private:
+  Arena arena_;
+  Arena thread_arenas_[kThreads];
+  SkipList<Key, Comparator> list_;
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  int done_ GUARDED_BY(mu_) = 0;
+};
+
+struct ConcurrentInserter {
+  ConcurrentInsertState* state;
+  int id;
+};
+
+static void ConcurrentInsertThread(void* arg) {
+  ConcurrentInserter* inserter = reinterpret_cast<ConcurrentInserter*>(arg);
+  inserter->state->Insert(inserter->id);
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  ConcurrentInsertState state;
+  ConcurrentInserter inserters[ConcurrentInsertState::kThreads];
+  for (int id = 0; id < ConcurrentInsertState::kThreads; id++) {
+    inserters[id].state = &state;
+    inserters[id].id = id;
+    Env::Default()->StartThread(ConcurrentInsertThread, &inserters[id]);
+  }
+  state.WaitForThreads();
+
+  const Key kTotal = static_cast<Key>(ConcurrentInsertState::kThreads) *
+                     ConcurrentInsertState::kPerThread;
+  SkipList<Key, Comparator>::Iterator iter(state.list());
+  iter.SeekToFirst();
+  for (Key k = 0; k < kTotal; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+
+  for (Key k = 0; k < kTotal; k += 997) {
+    ASSERT_TRUE(state.list()->Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+}
+
 }  // namespace leveldb
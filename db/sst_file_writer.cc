@@ -0,0 +1,126 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// The table is built the same way the database builds its own tables:
+// keys are internal keys and the filter policy and prefix extractor see
+// user keys.  Every entry gets sequence number zero; the database assigns
+// the real sequence number when the file is ingested.
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& raw_options)
+      : internal_comparator(raw_options.comparator),
+        internal_filter_policy(raw_options.filter_policy),
+        internal_prefix_extractor(raw_options.prefix_extractor),
+        options(raw_options),
+        file(nullptr),
+        builder(nullptr),
+        has_last_key(false),
+        finished(false) {
+    options.comparator = &internal_comparator;
+    if (raw_options.filter_policy != nullptr) {
+      options.filter_policy = &internal_filter_policy;
+    }
+    if (raw_options.prefix_extractor != nullptr) {
+      options.prefix_extractor = &internal_prefix_extractor;
+    }
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  const InternalKeySliceTransform internal_prefix_extractor;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // Last user key added
+  bool has_last_key;
+  bool finished;
+  std::string key_buf;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr && !rep_->finished) {
+    rep_->builder->Abandon();
+    delete rep_->file;
+    rep_->options.env->RemoveFile(rep_->fname);
+  } else {
+    delete rep_->file;
+  }
+  delete rep_->builder;
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  assert(rep_->builder == nullptr);
+  rep_->fname = fname;
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, kTypeValue, value);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, kTypeDeletion, Slice());
+}
+
+Status SstFileWriter::Add(const Slice& key, int type, const Slice& value) {
+  Rep* r = rep_;
+  if (r->builder == nullptr || r->finished) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (r->has_last_key &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument(
+        "Keys must be added in strictly increasing order");
+  }
+  r->last_key.assign(key.data(), key.size());
+  r->has_last_key = true;
+
+  r->key_buf.clear();
+  AppendInternalKey(&r->key_buf,
+                    ParsedInternalKey(key, 0, static_cast<ValueType>(type)));
+  r->builder->Add(r->key_buf, value);
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == nullptr || r->finished) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (!r->has_last_key) {
+    return Status::InvalidArgument("Cannot create a table with no entries");
+  }
+  r->finished = true;
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder != nullptr ? rep_->builder->FileSize() : 0;
+}
+
+}  // namespace leveldb
@@ -4,7 +4,10 @@
 
 #include "db/table_cache.h"
 
+#include <algorithm>
+
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
@@ -14,10 +17,14 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* range_dels;  // nullptr if the table has none
+  SequenceNumber global_sequence;  // Zero if keys keep their own sequence
+  uint64_t file_number;
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_dels;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -29,16 +36,181 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+namespace {
+
+// Replace the sequence number of internal key "key" with "sequence".
+void RewriteSequence(const Slice& key, SequenceNumber sequence,
+                     std::string* result) {
+  const ValueType type =
+      static_cast<ValueType>(DecodeFixed64(key.data() + key.size() - 8) & 0xff);
+  result->clear();
+  AppendInternalKey(result,
+                    ParsedInternalKey(ExtractUserKey(key), sequence, type));
+}
+
+// Yields the entries of a table whose keys were all written with sequence
+// number zero as if they had been written with "sequence".  The table
+// holds at most one entry per user key, so rewriting the sequence numbers
+// does not change the order of the entries.
+class GlobalSequenceIterator : public Iterator {
+ public:
+  GlobalSequenceIterator(const Comparator* user_comparator, Iterator* iter,
+                         SequenceNumber sequence)
+      : ucmp_(user_comparator), iter_(iter), sequence_(sequence) {}
+
+  ~GlobalSequenceIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    // The entry for the target's user key sorts before the target if it
+    // is newer than the target's sequence number.
+    if (iter_->Valid() &&
+        ucmp_->Compare(ExtractUserKey(iter_->key()), ExtractUserKey(target)) ==
+            0 &&
+        sequence_ > DecodeFixed64(target.data() + target.size() - 8) >> 8) {
+      iter_->Next();
+    }
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      RewriteSequence(iter_->key(), sequence_, &key_);
+    }
+  }
+
+  const Comparator* const ucmp_;
+  Iterator* const iter_;
+  const SequenceNumber sequence_;
+  std::string key_;
+};
+
+// Passes the entries found by Table::InternalGet() on to the caller's
+// handle_result with their sequence number replaced by "sequence".
+struct GlobalSequenceSaver {
+  SequenceNumber sequence;
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+};
+
+void SaveWithGlobalSequence(void* arg, const Slice& k, const Slice& v) {
+  GlobalSequenceSaver* saver = reinterpret_cast<GlobalSequenceSaver*>(arg);
+  std::string key;
+  RewriteSequence(k, saver->sequence, &key);
+  (*saver->handle_result)(saver->arg, key, v);
+}
+
+// The newest entry of a file for a user key, if any, and the newest range
+// tombstone of the file covering the key, kept in Options::row_cache.  File
+// contents never change, so the row stays valid for as long as the file
+// number is in use.  It answers lookups at sequence numbers that are not
+// older than the row.
+struct Row {
+  std::string key;  // Internal key of the entry; empty if there is none
+  std::string value;
+  SequenceNumber tombstone_seq;
+  SequenceNumber sequence;  // Newest of the entry and the tombstone
+};
+
+void DeleteRow(const Slice& key, void* value) {
+  delete reinterpret_cast<Row*>(value);
+}
+
+// Collects the entry found by a lookup into a Row.
+struct RowSaver {
+  const Comparator* ucmp;
+  Slice user_key;
+  Row* row;
+  bool corrupt;
+};
+
+void SaveRow(void* arg, const Slice& k, const Slice& v) {
+  RowSaver* saver = reinterpret_cast<RowSaver*>(arg);
+  ParsedInternalKey parsed_key;
+  if (!ParseInternalKey(k, &parsed_key)) {
+    saver->corrupt = true;
+  } else if (saver->ucmp->Compare(parsed_key.user_key, saver->user_key) == 0) {
+    saver->row->key.assign(k.data(), k.size());
+    saver->row->value.assign(v.data(), v.size());
+  }
+}
+
+// Passes "row" on to handle_result like a lookup in its file would.
+void ReplayRow(const Row* row, void* arg,
+               void (*handle_result)(void*, const Slice&, const Slice&),
+               SequenceNumber* tombstone_seq) {
+  if (row->tombstone_seq > *tombstone_seq) {
+    *tombstone_seq = row->tombstone_seq;
+  }
+  if (!row->key.empty()) {
+    (*handle_result)(arg, row->key, row->value);
+  }
+}
+
+std::string RowCacheKey(uint64_t row_cache_id, uint64_t file_number,
+                        const Slice& user_key) {
+  std::string key;
+  PutFixed64(&key, row_cache_id);
+  PutFixed64(&key, file_number);
+  key.append(user_key.data(), user_key.size());
+  return key;
+}
+
+}  // namespace
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      cache_(NewLRUCache(entries)),
+      row_cache_id_(options.row_cache ? options.row_cache->NewId() : 0) {}
 
 TableCache::~TableCache() { delete cache_; }
 
+Status TableCache::OpenTableFile(const std::string& fname,
+                                 RandomAccessFile** file) {
+  if (options_.use_direct_reads) {
+    Status s = env_->NewDirectRandomAccessFile(fname, file);
+    if (s.IsNotSupportedError()) {
+      s = Status::NotSupported(fname, "use_direct_reads");
+    }
+    return s;
+  }
+  if (options_.use_mmap_reads) {
+    Status s = env_->NewMmapRandomAccessFile(fname, file);
+    if (s.ok()) {
+      // Most reads are point lookups; scans hint their own ranges.
+      (*file)->Hint(0, 0, RandomAccessFile::kRandom);
+    }
+    return s;
+  }
+  return env_->NewRandomAccessFile(fname, file);
+}
+
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             SequenceNumber global_sequence,
                              Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
@@ -49,16 +221,34 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
+    s = OpenTableFile(fname, &file);
     if (!s.ok()) {
       std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
+      if (OpenTableFile(old_fname, &file).ok()) {
         s = Status::OK();
       }
     }
     if (s.ok()) {
       s = Table::Open(options_, file, file_size, &table);
     }
+    RangeTombstoneList* range_dels = nullptr;
+    if (s.ok()) {
+      Iterator* iter = table->NewRangeTombstoneIterator();
+      if (iter != nullptr) {
+        const Comparator* ucmp =
+            static_cast<const InternalKeyComparator*>(options_.comparator)
+                ->user_comparator();
+        range_dels = new RangeTombstoneList(ucmp);
+        s = range_dels->AddAll(iter);
+        range_dels->Finish();
+        delete iter;
+        if (!s.ok()) {
+          delete range_dels;
+          delete table;
+          table = nullptr;
+        }
+      }
+    }
 
     if (!s.ok()) {
       assert(table == nullptr);
@@ -69,6 +259,9 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_dels = range_dels;
+      tf->global_sequence = global_sequence;
+      tf->file_number = file_number;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -77,19 +270,27 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
+                                  SequenceNumber global_sequence,
                                   Table** tableptr) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, global_sequence, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
-  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  Table* table = tf->table;
   Iterator* result = table->NewIterator(options);
+  if (tf->global_sequence != 0) {
+    result = new GlobalSequenceIterator(
+        static_cast<const InternalKeyComparator*>(options_.comparator)
+            ->user_comparator(),
+        result, tf->global_sequence);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -98,19 +299,167 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 }
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, SequenceNumber global_sequence,
+                       const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       SequenceNumber* tombstone_seq) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, global_sequence, &handle);
   if (s.ok()) {
-    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    s = Get(options, handle, k, arg, handle_result, tombstone_seq);
     cache_->Release(handle);
   }
   return s;
 }
 
+Status TableCache::Get(const ReadOptions& options, Cache::Handle* handle,
+                       const Slice& k, void* arg,
+                       void (*handle_result)(void*, const Slice&,
+                                             const Slice&),
+                       SequenceNumber* tombstone_seq) {
+  Cache* row_cache = options_.row_cache;
+  if (row_cache == nullptr || !options.fill_cache) {
+    return GetFromTable(options, handle, k, arg, handle_result, tombstone_seq);
+  }
+
+  // A row that is already cached is too new for this lookup (see
+  // GetFromRowCache()).
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  const Slice user_key = ExtractUserKey(k);
+  const std::string row_key =
+      RowCacheKey(row_cache_id_, tf->file_number, user_key);
+  Cache::Handle* row_handle = row_cache->Lookup(row_key);
+  if (row_handle != nullptr) {
+    row_cache->Release(row_handle);
+    return GetFromTable(options, handle, k, arg, handle_result, tombstone_seq);
+  }
+
+  // Look up the newest entry of the file, which does for every lookup that
+  // is not older than it, and remember it in the row cache.
+  Row* row = new Row;
+  row->tombstone_seq = 0;
+  RowSaver saver;
+  saver.ucmp = static_cast<const InternalKeyComparator*>(options_.comparator)
+                   ->user_comparator();
+  saver.user_key = user_key;
+  saver.row = row;
+  saver.corrupt = false;
+  InternalKey newest(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  Status s = GetFromTable(options, handle, newest.Encode(), &saver, SaveRow,
+                          &row->tombstone_seq);
+  if (!s.ok() || saver.corrupt) {
+    delete row;
+    return GetFromTable(options, handle, k, arg, handle_result, tombstone_seq);
+  }
+  row->sequence = row->tombstone_seq;
+  if (!row->key.empty()) {
+    row->sequence = std::max(row->sequence,
+                             DecodeFixed64(row->key.data() + row->key.size() -
+                                           8) >> 8);
+  }
+  const bool usable =
+      row->sequence <= DecodeFixed64(k.data() + k.size() - 8) >> 8;
+  if (usable) {
+    ReplayRow(row, arg, handle_result, tombstone_seq);
+  }
+  const size_t charge = sizeof(Row) + row->key.size() + row->value.size();
+  row_cache->Release(row_cache->Insert(row_key, row, charge, &DeleteRow));
+  if (usable) {
+    return Status::OK();
+  }
+  return GetFromTable(options, handle, k, arg, handle_result, tombstone_seq);
+}
+
+bool TableCache::GetFromRowCache(uint64_t file_number, const Slice& k,
+                                 void* arg,
+                                 void (*handle_result)(void*, const Slice&,
+                                                       const Slice&),
+                                 SequenceNumber* tombstone_seq) {
+  Cache* row_cache = options_.row_cache;
+  if (row_cache == nullptr) {
+    return false;
+  }
+  Cache::Handle* handle = row_cache->Lookup(
+      RowCacheKey(row_cache_id_, file_number, ExtractUserKey(k)));
+  if (handle == nullptr) {
+    return false;
+  }
+  const Row* row = reinterpret_cast<Row*>(row_cache->Value(handle));
+  const bool usable =
+      row->sequence <= DecodeFixed64(k.data() + k.size() - 8) >> 8;
+  if (usable) {
+    ReplayRow(row, arg, handle_result, tombstone_seq);
+  }
+  row_cache->Release(handle);
+  return usable;
+}
+
+Status TableCache::GetFromTable(const ReadOptions& options,
+                                Cache::Handle* handle, const Slice& k,
+                                void* arg,
+                                void (*handle_result)(void*, const Slice&,
+                                                      const Slice&),
+                                SequenceNumber* tombstone_seq) {
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  if (tf->range_dels != nullptr) {
+    const SequenceNumber seq = tf->range_dels->MaxCoveringSeq(
+        ExtractUserKey(k), DecodeFixed64(k.data() + k.size() - 8) >> 8);
+    if (seq > *tombstone_seq) {
+      *tombstone_seq = seq;
+    }
+  }
+  if (tf->global_sequence != 0) {
+    if (tf->global_sequence > DecodeFixed64(k.data() + k.size() - 8) >> 8) {
+      // Every entry in the table is newer than the lookup.
+      return Status::OK();
+    }
+    GlobalSequenceSaver saver;
+    saver.sequence = tf->global_sequence;
+    saver.arg = arg;
+    saver.handle_result = handle_result;
+    return tf->table->InternalGet(options, k, &saver, SaveWithGlobalSequence);
+  }
+  return tf->table->InternalGet(options, k, arg, handle_result);
+}
+
+void TableCache::Prefetch(const ReadOptions& options, Cache::Handle* handle,
+                          const std::vector<Slice>& keys,
+                          std::vector<bool>* may_match) {
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  tf->table->Prefetch(options, keys, may_match);
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      RangeTombstoneList* list) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, 0, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->range_dels != nullptr) {
+      for (const RangeTombstone& t : tf->range_dels->tombstones()) {
+        list->Add(t.begin, t.end, t.seq);
+      }
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                                SequenceNumber global_sequence,
+                                const Slice& target) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, global_sequence, &handle).ok()) {
+    return true;  // Let the iterator over the file report the error
+  }
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  const bool may_match = tf->table->PrefixMayMatch(target);
+  cache_->Release(handle);
+  return may_match;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
@@ -9,6 +9,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
@@ -18,6 +19,7 @@
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 class TableCache {
  public:
@@ -29,31 +31,91 @@ class TableCache {
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes).  If "global_sequence"
+  // is non-zero, the keys of the file are yielded with that sequence
+  // number (see FileMetaData::global_sequence).  If "tableptr" is
   // non-null, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, SequenceNumber global_sequence,
+                        Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  Also raises
+  // *tombstone_seq to the sequence number of the newest range tombstone
+  // in the file that covers the user key of "k" and is visible at the
+  // sequence number of "k".
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             uint64_t file_size, SequenceNumber global_sequence,
+             const Slice& k, void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             SequenceNumber* tombstone_seq);
+
+  // Like Get(), but uses a table previously pinned by FindTable() instead
+  // of looking the file up in the cache again.
+  Status Get(const ReadOptions& options, Cache::Handle* handle,
+             const Slice& k, void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             SequenceNumber* tombstone_seq);
+
+  // If Options::row_cache holds the result of a lookup of the user key of
+  // "k" in the specified file that is valid at the sequence number of "k",
+  // passes it on like Get() would and returns true.  Otherwise returns
+  // false without touching the file.
+  bool GetFromRowCache(uint64_t file_number, const Slice& k, void* arg,
+                       void (*handle_result)(void*, const Slice&,
+                                             const Slice&),
+                       SequenceNumber* tombstone_seq);
+
+  // Add the range tombstones of the specified file to *list.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneList* list);
+
+  // Returns false if the filters of the specified file show that it has
+  // no key sharing the prefix of internal key "target" that is not before
+  // "target".  Returns true if the file cannot be opened.
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      SequenceNumber global_sequence, const Slice& target);
+
+  // Read the data blocks that Get() of each of "keys" from a table
+  // previously pinned by FindTable() would read, as one batch, into the
+  // block cache.  Sets (*may_match)[i] to false if the table cannot hold
+  // an entry for keys[i].
+  void Prefetch(const ReadOptions& options, Cache::Handle* handle,
+                const std::vector<Slice>& keys, std::vector<bool>* may_match);
+
+  // Pin the table for the specified file in the cache, opening it if
+  // necessary.  On success the caller must eventually pass *handle to
+  // ReleaseHandle().
+  Status FindTable(uint64_t file_number, uint64_t file_size,
+                   SequenceNumber global_sequence, Cache::Handle**);
+
+  // Release a handle returned by FindTable().
+  void ReleaseHandle(Cache::Handle* handle) { cache_->Release(handle); }
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // Does the work of Get() once the table is pinned, bypassing the row
+  // cache.
+  Status GetFromTable(const ReadOptions& options, Cache::Handle* handle,
+                      const Slice& k, void* arg,
+                      void (*handle_result)(void*, const Slice&, const Slice&),
+                      SequenceNumber* tombstone_seq);
+
+  // Opens a table file as options_.use_direct_reads and
+  // options_.use_mmap_reads ask for.
+  Status OpenTableFile(const std::string& fname, RandomAccessFile** file);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
   Cache* cache_;
+  const uint64_t row_cache_id_;  // Prefix of our keys in options_.row_cache
 };
 
 }  // namespace leveldb
@@ -20,7 +20,11 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // Same encoding as kNewFile, for files that contain range tombstones
+  kNewFileWithRangeDeletions = 10,
+  // kNewFile followed by the file's global sequence number
+  kNewFileWithGlobalSequence = 11
 };
 
 void VersionEdit::Clear() {
@@ -75,12 +79,23 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Ingested files never hold range tombstones.
+    assert(f.global_sequence == 0 || !f.has_range_deletions);
+    if (f.global_sequence != 0) {
+      PutVarint32(dst, kNewFileWithGlobalSequence);
+    } else if (f.has_range_deletions) {
+      PutVarint32(dst, kNewFileWithRangeDeletions);
+    } else {
+      PutVarint32(dst, kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.global_sequence != 0) {
+      PutVarint64(dst, f.global_sequence);
+    }
   }
 }
 
@@ -176,10 +191,27 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeDeletions:
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
+          f.global_sequence = 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+
+      case kNewFileWithGlobalSequence:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.global_sequence) &&
+            f.global_sequence != 0) {
+          f.has_range_deletions = false;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -250,6 +282,10 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.global_sequence != 0) {
+      r.append(" @");
+      AppendNumberTo(&r, f.global_sequence);
+    }
   }
   r.append("\n}\n");
   return r;
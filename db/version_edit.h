@@ -16,7 +16,13 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        being_compacted(false),
+        has_range_deletions(false),
+        global_sequence(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +30,13 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool being_compacted;  // Is the file an input of a running compaction?
+  bool has_range_deletions;  // Does the table contain range tombstones?
+
+  // If non-zero, the sequence number of every entry in the table,
+  // overriding the (zero) sequence numbers stored in the file.  Set for
+  // files added by DB::IngestExternalFile().
+  SequenceNumber global_sequence;
 };
 
 class VersionEdit {
@@ -59,22 +72,39 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  // including the bounds of its range tombstones
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by the persistent fields of "f" at the
+  // specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest,
+            f.has_range_deletions);
+    new_files_.back().second.global_sequence = f.global_sequence;
+  }
+
   // Delete the specified "file" from the specified "level".
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // The files added by this edit, with their levels.
+  const std::vector<std::pair<int, FileMetaData>>& new_files() const {
+    return new_files_;
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -27,6 +27,13 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
                  InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    FileMetaData f;
+    f.number = kBig + 800 + i;
+    f.file_size = kBig + 850 + i;
+    f.smallest = InternalKey("bar", kBig + 860 + i, kTypeValue);
+    f.largest = InternalKey("baz", kBig + 860 + i, kTypeValue);
+    f.global_sequence = kBig + 860 + i;
+    edit.AddFile(2, f);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
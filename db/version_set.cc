@@ -18,6 +18,7 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -158,8 +159,8 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
@@ -194,6 +195,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_sequence);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
@@ -203,45 +205,105 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
+static bool FileMayMatch(void* arg, const Slice& file_value,
+                         const Slice& target) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 24) {
+    return true;  // GetFileIterator() reports the corruption
+  }
+  return cache->PrefixMayMatch(DecodeFixed64(file_value.data()),
+                               DecodeFixed64(file_value.data() + 8),
+                               DecodeFixed64(file_value.data() + 16), target);
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      &FileMayMatch, &vset_->icmp_, vset_->table_cache_, options);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  const InternalKeyComparator& icmp = vset_->icmp_;
+  const Slice* lower = options.iterate_lower_bound;
+  const Slice* upper = options.iterate_upper_bound;
+
   // Merge all level zero files together since they may overlap
-  for (size_t i = 0; i < files_[0].size(); i++) {
+  for (FileMetaData* f : files_[0]) {
+    if ((upper != nullptr && icmp.Compare(f->smallest.Encode(), *upper) >= 0) ||
+        (lower != nullptr && icmp.Compare(f->largest.Encode(), *lower) < 0)) {
+      continue;  // Entirely outside of the bounds
+    }
     iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+        options, f->number, f->file_size, f->global_sequence));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
   for (int level = 1; level < config::kNumLevels; level++) {
-    if (!files_[level].empty()) {
-      iters->push_back(NewConcatenatingIterator(options, level));
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) {
+      continue;
+    }
+    if (lower != nullptr || upper != nullptr) {
+      // Skip the level if no file overlaps the bounds
+      const size_t index =
+          (lower != nullptr) ? FindFile(icmp, files, *lower) : 0;
+      if (index == files.size() ||
+          (upper != nullptr &&
+           icmp.Compare(files[index]->smallest.Encode(), *upper) >= 0)) {
+        continue;
+      }
+    }
+    iters->push_back(NewConcatenatingIterator(options, level));
+  }
+}
+
+Status Version::GetRangeTombstones(
+    std::shared_ptr<const RangeTombstoneList>* list) {
+  MutexLock l(&range_dels_mu_);
+  if (!range_dels_built_) {
+    std::unique_ptr<RangeTombstoneList> range_dels(
+        new RangeTombstoneList(vset_->icmp_.user_comparator()));
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : files_[level]) {
+        if (f->has_range_deletions) {
+          Status s = vset_->table_cache_->AddRangeTombstones(
+              f->number, f->file_size, range_dels.get());
+          if (!s.ok()) {
+            return s;
+          }
+        }
+      }
+    }
+    range_dels->Finish();
+    if (!range_dels->empty()) {
+      range_dels_.reset(range_dels.release());
     }
+    range_dels_built_ = true;
   }
+  *list = range_dels_;
+  return Status::OK();
 }
 
 // Callback from TableCache::Get()
@@ -257,6 +319,7 @@ struct Saver {
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  SequenceNumber sequence;  // Of the entry found, if any
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -267,6 +330,7 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->sequence = parsed_key.sequence;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
@@ -321,8 +385,134 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 }
 
+// Table cache handles pinned for the duration of one MultiGet() call.
+class Version::PinnedTables {
+ public:
+  explicit PinnedTables(TableCache* cache) : cache_(cache) {}
+
+  PinnedTables(const PinnedTables&) = delete;
+  PinnedTables& operator=(const PinnedTables&) = delete;
+
+  ~PinnedTables() {
+    for (const auto& kvp : handles_) {
+      cache_->ReleaseHandle(kvp.second);
+    }
+  }
+
+  Status Get(const ReadOptions& options, FileMetaData* f, const Slice& k,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             SequenceNumber* tombstone_seq) {
+    Cache::Handle* handle;
+    Status s = Find(f, &handle);
+    if (!s.ok()) {
+      return s;
+    }
+    return cache_->Get(options, handle, k, arg, handle_result, tombstone_seq);
+  }
+
+  void Prefetch(const ReadOptions& options, FileMetaData* f,
+                const std::vector<Slice>& keys, std::vector<bool>* may_match) {
+    Cache::Handle* handle;
+    if (!Find(f, &handle).ok()) {
+      // The lookups stop at this file and report the error.
+      may_match->assign(keys.size(), true);
+      return;
+    }
+    cache_->Prefetch(options, handle, keys, may_match);
+  }
+
+ private:
+  Status Find(FileMetaData* f, Cache::Handle** handle) {
+    auto iter = handles_.find(f->number);
+    if (iter != handles_.end()) {
+      *handle = iter->second;
+      return Status::OK();
+    }
+    Status s = cache_->FindTable(f->number, f->file_size, f->global_sequence,
+                                 handle);
+    if (s.ok()) {
+      handles_.insert(std::make_pair(f->number, *handle));
+    }
+    return s;
+  }
+
+  TableCache* const cache_;
+  std::map<uint64_t, Cache::Handle*> handles_;
+};
+
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
                     std::string* value, GetStats* stats) {
+  return Get(options, k, value, stats, nullptr);
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& vals,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  assert(keys.size() == vals.size());
+  statuses->resize(keys.size());
+  stats->resize(keys.size());
+  PinnedTables pinned(vset_->table_cache_);
+  if (keys.size() > 1 && options.fill_cache) {
+    PrefetchBlocks(options, keys, &pinned);
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, *keys[i], vals[i], &(*stats)[i], &pinned);
+  }
+}
+
+static bool CollectFile(void* arg, int level, FileMetaData* f) {
+  reinterpret_cast<std::vector<FileMetaData*>*>(arg)->push_back(f);
+  return true;
+}
+
+void Version::PrefetchBlocks(const ReadOptions& options,
+                             const std::vector<const LookupKey*>& keys,
+                             PinnedTables* pinned) {
+  // The files each key may be found in, in search order.
+  std::vector<std::vector<FileMetaData*>> candidates(keys.size());
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < keys.size(); i++) {
+    ForEachOverlapping(keys[i]->user_key(), keys[i]->internal_key(),
+                       &candidates[i], &CollectFile);
+    pending.push_back(i);
+  }
+
+  // In round r, the keys that every earlier candidate ruled out try
+  // their r-th candidate.  The keys trying one file go in one batch.
+  for (size_t round = 0; !pending.empty(); round++) {
+    std::map<uint64_t, std::pair<FileMetaData*, std::vector<size_t>>> batches;
+    for (size_t i : pending) {
+      if (round < candidates[i].size()) {
+        FileMetaData* f = candidates[i][round];
+        auto& batch = batches[f->number];
+        batch.first = f;
+        batch.second.push_back(i);
+      }
+    }
+    pending.clear();
+    for (const auto& kvp : batches) {
+      const std::vector<size_t>& indexes = kvp.second.second;
+      std::vector<Slice> batch_keys;
+      for (size_t i : indexes) {
+        batch_keys.push_back(keys[i]->internal_key());
+      }
+      std::vector<bool> may_match;
+      pinned->Prefetch(options, kvp.second.first, batch_keys, &may_match);
+      for (size_t j = 0; j < indexes.size(); j++) {
+        if (!may_match[j]) {
+          pending.push_back(indexes[j]);
+        }
+      }
+    }
+  }
+}
+
+Status Version::Get(const ReadOptions& options, const LookupKey& k,
+                    std::string* value, GetStats* stats,
+                    PinnedTables* pinned) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -335,9 +525,15 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     int last_file_read_level;
 
     VersionSet* vset;
+    PinnedTables* pinned;
     Status s;
     bool found;
 
+    // Newest range tombstone covering the key in the files searched so far.
+    // Files are searched from newest to oldest, so older files cannot hold
+    // anything newer than it.
+    SequenceNumber tombstone_seq;
+
     static bool Match(void* arg, int level, FileMetaData* f) {
       State* state = reinterpret_cast<State*>(arg);
 
@@ -351,13 +547,30 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      if (state->vset->table_cache_->GetFromRowCache(
+              f->number, state->ikey, &state->saver, SaveValue,
+              &state->tombstone_seq)) {
+        state->s = Status::OK();
+      } else if (state->pinned != nullptr) {
+        state->s = state->pinned->Get(*state->options, f, state->ikey,
+                                      &state->saver, SaveValue,
+                                      &state->tombstone_seq);
+      } else {
+        state->s = state->vset->table_cache_->Get(
+            *state->options, f->number, f->file_size, f->global_sequence,
+            state->ikey,
+            &state->saver, SaveValue, &state->tombstone_seq);
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
+      if (state->tombstone_seq > 0 && state->saver.state != kCorrupt &&
+          (state->saver.state == kNotFound ||
+           state->saver.sequence < state->tombstone_seq)) {
+        // Deleted by a range tombstone
+        return false;
+      }
       switch (state->saver.state) {
         case kNotFound:
           return true;  // Keep searching in other files
@@ -388,11 +601,13 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.options = &options;
   state.ikey = k.internal_key();
   state.vset = vset_;
+  state.pinned = pinned;
 
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.tombstone_seq = 0;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
@@ -537,6 +752,72 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
   }
 }
 
+void Version::GetDeletableFilesInRange(
+    const Slice* begin, const Slice* end,
+    std::vector<std::pair<int, FileMetaData*>>* files) {
+  files->clear();
+  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  std::set<const FileMetaData*> picked;
+
+  // Returns true iff every file older than "f" (held by a deeper level,
+  // or by level-0 with a smaller number) that overlaps "f" is picked.
+  auto older_files_picked = [&](int level, const FileMetaData* f) {
+    const Slice file_start = f->smallest.user_key();
+    const Slice file_limit = f->largest.user_key();
+    if (level == 0) {
+      for (const FileMetaData* g : files_[0]) {
+        if (g->number < f->number &&
+            user_cmp->Compare(g->largest.user_key(), file_start) >= 0 &&
+            user_cmp->Compare(g->smallest.user_key(), file_limit) <= 0 &&
+            picked.count(g) == 0) {
+          return false;
+        }
+      }
+    }
+    InternalKey start_key(file_start, kMaxSequenceNumber, kValueTypeForSeek);
+    for (int deeper = std::max(level + 1, 1); deeper < config::kNumLevels;
+         deeper++) {
+      const std::vector<FileMetaData*>& deeper_files = files_[deeper];
+      for (size_t i = FindFile(vset_->icmp_, deeper_files, start_key.Encode());
+           i < deeper_files.size(); i++) {
+        const FileMetaData* g = deeper_files[i];
+        if (user_cmp->Compare(g->smallest.user_key(), file_limit) > 0) {
+          break;
+        }
+        if (picked.count(g) == 0) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  // Visit files from oldest to newest so that the older files a
+  // candidate depends on have already been decided.
+  for (int level = config::kNumLevels - 1; level >= 0; level--) {
+    std::vector<FileMetaData*> candidates = files_[level];
+    if (level == 0) {
+      std::sort(candidates.begin(), candidates.end(),
+                [](FileMetaData* a, FileMetaData* b) {
+                  return a->number < b->number;
+                });
+    }
+    for (FileMetaData* f : candidates) {
+      if (f->being_compacted ||
+          (begin != nullptr &&
+           user_cmp->Compare(f->smallest.user_key(), *begin) < 0) ||
+          (end != nullptr &&
+           user_cmp->Compare(f->largest.user_key(), *end) > 0)) {
+        continue;
+      }
+      if (older_files_picked(level, f)) {
+        picked.insert(f);
+        files->push_back(std::make_pair(level, f));
+      }
+    }
+  }
+}
+
 std::string Version::DebugString() const {
   std::string r;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -787,7 +1068,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   }
 
   edit->SetNextFile(next_file_number_);
-  edit->SetLastSequence(last_sequence_);
+  edit->SetLastSequence(LastSequence());
 
   Version* v = new Version(this);
   {
@@ -972,7 +1253,7 @@ Status VersionSet::Recover(bool* save_manifest) {
     AppendVersion(v);
     manifest_file_number_ = next_file;
     next_file_number_ = next_file + 1;
-    last_sequence_ = last_sequence;
+    SetLastSequence(last_sequence);
     log_number_ = log_number;
     prev_log_number_ = prev_log_number;
 
@@ -1056,6 +1337,7 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1087,7 +1369,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
@@ -1135,7 +1417,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->global_sequence, &tableptr);
         if (tableptr != nullptr) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1220,6 +1503,7 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.readahead_size = options_->compaction_readahead_size;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1228,17 +1512,20 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   Iterator** list = new Iterator*[space];
   int num = 0;
   for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
+    const std::vector<FileMetaData*>& files =
+        (which == 1 && c->dropped_covered_inputs_) ? c->inputs_to_read_
+                                                   : c->inputs_[which];
+    if (!files.empty()) {
       if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size,
+              files[i]->global_sequence);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &files),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1249,60 +1536,171 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+// Returns true iff any of "files" is an input of a running compaction.
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (FileMetaData* f : files) {
+    if (f->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
 
+Compaction* VersionSet::PickCompaction() {
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+  // the compactions triggered by seeks.  Levels are tried in order of
+  // decreasing score, so that a level whose files are all claimed by
+  // running compactions does not hold up compactions of other levels.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [this](int a, int b) {
+                     return current_->level_scores_[a] >
+                            current_->level_scores_[b];
+                   });
+
+  for (int level : levels) {
+    if (current_->level_scores_[level] < 1) {
+      break;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    // Files in level 0 may overlap each other, so only one level-0
+    // compaction may run at a time.
+    if (level == 0 && AnyBeingCompacted(files)) {
+      continue;
+    }
+
+    // Try the first file that comes after compact_pointer_[level] first,
+    // wrapping around to the beginning of the key space.
+    size_t start = 0;
+    if (!compact_pointer_[level].empty()) {
+      while (start < files.size() &&
+             icmp_.Compare(files[start]->largest.Encode(),
+                           compact_pointer_[level]) <= 0) {
+        start++;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[(start + i) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = new Compaction(options_, level);
+      c->input_version_ = current_;
+      c->input_version_->Ref();
+      c->inputs_[0].push_back(f);
+
+      if (level == 0) {
+        InternalKey smallest, largest;
+        GetRange(c->inputs_[0], &smallest, &largest);
+        // Note that the next call will discard the file we placed in
+        // c->inputs_[0] earlier and replace it with an overlapping set
+        // which will include the picked file.
+        current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+        assert(!c->inputs_[0].empty());
+      }
+
+      SetupOtherInputs(c);
+      if (!ConflictsWithRunningCompactions(c)) {
+        RegisterCompaction(c);
+        return c;
+      }
+      delete c;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  FileMetaData* f = current_->file_to_compact_;
+  if (f == nullptr || f->being_compacted) {
+    return nullptr;
+  }
+  const int level = current_->file_to_compact_level_;
+  if (level == 0 && AnyBeingCompacted(current_->files_[0])) {
+    return nullptr;
+  }
+  Compaction* c = new Compaction(options_, level);
   c->input_version_ = current_;
   c->input_version_->Ref();
+  c->inputs_[0].push_back(f);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
     InternalKey smallest, largest;
     GetRange(c->inputs_[0], &smallest, &largest);
-    // Note that the next call will discard the file we placed in
-    // c->inputs_[0] earlier and replace it with an overlapping set
-    // which will include the picked file.
     current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
     assert(!c->inputs_[0].empty());
   }
 
   SetupOtherInputs(c);
-
+  if (ConflictsWithRunningCompactions(c)) {
+    delete c;
+    return nullptr;
+  }
+  RegisterCompaction(c);
   return c;
 }
 
+bool VersionSet::ConflictsWithRunningCompactions(Compaction* c) const {
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return true;
+  }
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const Compaction* r : running_compactions_) {
+    if (r->level_ == c->level_ &&
+        user_cmp->Compare(r->smallest_.user_key(), c->largest_.user_key()) <=
+            0 &&
+        user_cmp->Compare(c->smallest_.user_key(), r->largest_.user_key()) <=
+            0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      assert(!f->being_compacted);
+      f->being_compacted = true;
+    }
+  }
+  running_compactions_.push_back(c);
+
+  // Update the place where we will do the next compaction for this level.
+  // We update this immediately instead of waiting for the VersionEdit
+  // to be applied so that if the compaction fails, we will try a different
+  // key range next time.
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
+  compact_pointer_[c->level_] = largest.Encode().ToString();
+  c->edit_.SetCompactPointer(c->level_, largest);
+}
+
+void VersionSet::ReleaseCompaction(Compaction* c) {
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = false;
+    }
+  }
+  running_compactions_.erase(std::find(running_compactions_.begin(),
+                                       running_compactions_.end(), c));
+}
+
+bool VersionSet::RangeBeingCompactedInto(int level,
+                                         const Slice& smallest_user_key,
+                                         const Slice& largest_user_key) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (const Compaction* r : running_compactions_) {
+    if (r->level_ + 1 == level &&
+        user_cmp->Compare(r->smallest_.user_key(), largest_user_key) <= 0 &&
+        user_cmp->Compare(smallest_user_key, r->largest_.user_key()) <= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Finds the largest key in a vector of files. Returns true if files is not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1408,7 +1806,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1421,8 +1820,6 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
             level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
             long(inputs0_size), long(inputs1_size), int(expanded0.size()),
             int(expanded1.size()), long(expanded0_size), long(inputs1_size));
-        smallest = new_start;
-        largest = new_limit;
         c->inputs_[0] = expanded0;
         c->inputs_[1] = expanded1;
         GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
@@ -1430,19 +1827,15 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     }
   }
 
+  c->smallest_ = all_start;
+  c->largest_ = all_limit;
+
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
   if (level + 2 < config::kNumLevels) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
-
-  // Update the place where we will do the next compaction for this level.
-  // We update this immediately instead of waiting for the VersionEdit
-  // to be applied so that if the compaction fails, we will try a different
-  // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
-  c->edit_.SetCompactPointer(level, largest);
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1475,6 +1868,8 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  assert(!ConflictsWithRunningCompactions(c));
+  RegisterCompaction(c);
   return c;
 }
 
@@ -1482,6 +1877,7 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
+      dropped_covered_inputs_(false),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
@@ -1535,6 +1931,42 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Compaction::DropCoveredInputs(const std::vector<RangeTombstone>& tombstones,
+                                  SequenceNumber snapshot) {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<FileMetaData*> to_read;
+  for (FileMetaData* f : inputs_[1]) {
+    bool covered = false;
+    for (const RangeTombstone& t : tombstones) {
+      if (t.seq <= snapshot &&
+          user_cmp->Compare(t.begin, f->smallest.user_key()) <= 0 &&
+          user_cmp->Compare(f->largest.user_key(), t.end) < 0) {
+        covered = true;
+        break;
+      }
+    }
+    if (!covered) {
+      to_read.push_back(f);
+    }
+  }
+  const int dropped = inputs_[1].size() - to_read.size();
+  if (dropped > 0) {
+    inputs_to_read_.swap(to_read);
+    dropped_covered_inputs_ = true;
+  }
+  return dropped;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
@@ -1566,4 +1998,52 @@ void Compaction::ReleaseInputs() {
   }
 }
 
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  std::vector<FileMetaData*> files(inputs_[0]);
+  files.insert(files.end(), inputs_[1].begin(), inputs_[1].end());
+  if (n <= 1 || files.size() <= 1) {
+    return;
+  }
+  const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp->user_comparator();
+  std::sort(files.begin(), files.end(),
+            [icmp](FileMetaData* a, FileMetaData* b) {
+              return icmp->Compare(a->largest, b->largest) < 0;
+            });
+
+  const Slice last_key = files.back()->largest.user_key();
+  const uint64_t total = TotalFileSize(files);
+  uint64_t seen = 0;
+  for (FileMetaData* f : files) {
+    seen += f->file_size;
+    const Slice key = f->largest.user_key();
+    if (static_cast<int>(boundaries->size()) + 1 >= n ||
+        user_cmp->Compare(key, last_key) >= 0) {
+      break;
+    }
+    // Cut once the pieces so far hold their share of the input.
+    if (seen * n >= total * (boundaries->size() + 1) &&
+        (boundaries->empty() ||
+         user_cmp->Compare(key, Slice(boundaries->back())) > 0)) {
+      boundaries->push_back(key.ToString());
+    }
+  }
+}
+
+Compaction* Compaction::NewSubcompaction() const {
+  Compaction* c = new Compaction(input_version_->vset_->options_, level_);
+  c->input_version_ = input_version_;
+  c->input_version_->Ref();
+  c->inputs_[0] = inputs_[0];
+  c->inputs_[1] = inputs_[1];
+  c->inputs_to_read_ = inputs_to_read_;
+  c->dropped_covered_inputs_ = dropped_covered_inputs_;
+  c->grandparents_ = grandparents_;
+  c->smallest_ = smallest_;
+  c->largest_ = largest_;
+  return c;
+}
+
 }  // namespace leveldb
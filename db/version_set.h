@@ -15,11 +15,14 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/version_edit.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -65,16 +68,34 @@ class Version {
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  The
+  // iterate bounds of the options, if any, must be encoded internal keys;
+  // files that lie entirely outside of them are left out.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Store the range tombstones of every file in this Version, fragmented
+  // for lookups, in *list, or nullptr if there are none.  The list is
+  // built on the first successful call and shared by the later ones.
+  Status GetRangeTombstones(std::shared_ptr<const RangeTombstoneList>* list);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Like Get(), but looks up a batch of keys sorted in increasing user
+  // key order.  Every table touched by the batch is pinned in the table
+  // cache once and reused by the later keys that fall into it, and the
+  // data blocks the lookups need are read in one batch per table first.
+  // Stores the outcome for keys[i] in *vals[i], (*statuses)[i] and
+  // (*stats)[i].
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& vals,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -97,6 +118,18 @@ class Version {
       const InternalKey* end,    // nullptr means after all keys
       std::vector<FileMetaData*>* inputs);
 
+  // Store in *files the (level, file) pairs of the files whose user key
+  // range lies entirely within [*begin,*end] and that can be removed
+  // without making older entries for their keys visible again, i.e. every
+  // older file that overlaps a picked file is picked too.  Inputs of a
+  // running compaction are never picked.
+  // begin==nullptr represents a key smaller than all the DB's keys.
+  // end==nullptr represents a key larger than all the DB's keys.
+  // REQUIRES: lock is held
+  void GetDeletableFilesInRange(
+      const Slice* begin, const Slice* end,
+      std::vector<std::pair<int, FileMetaData*>>* files);
+
   // Returns true iff some file in the specified level overlaps
   // some part of [*smallest_user_key,*largest_user_key].
   // smallest_user_key==nullptr represents a key smaller than all the DB's keys.
@@ -119,6 +152,7 @@ class Version {
   friend class VersionSet;
 
   class LevelFileNumIterator;
+  class PinnedTables;
 
   explicit Version(VersionSet* vset)
       : vset_(vset),
@@ -128,7 +162,12 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        range_dels_built_(false) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -137,6 +176,19 @@ class Version {
 
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // Implementation of Get().  If "pinned" is non-null, tables are looked
+  // up through it instead of directly in the table cache.
+  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
+             GetStats* stats, PinnedTables* pinned);
+
+  // Read the data blocks that looking up "keys" will start with into the
+  // block cache, with one batched read per table.  For each key, that is
+  // the block of the first file in search order whose index and filter do
+  // not rule the key out.
+  void PrefetchBlocks(const ReadOptions&,
+                      const std::vector<const LookupKey*>& keys,
+                      PinnedTables* pinned);
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -162,6 +214,15 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, also initialized by Finalize().
+  double level_scores_[config::kNumLevels];
+
+  // Cache of GetRangeTombstones().
+  port::Mutex range_dels_mu_;
+  bool range_dels_built_ GUARDED_BY(range_dels_mu_);
+  std::shared_ptr<const RangeTombstoneList> range_dels_
+      GUARDED_BY(range_dels_mu_);
 };
 
 class VersionSet {
@@ -208,13 +269,16 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
-  // Return the last sequence number.
-  uint64_t LastSequence() const { return last_sequence_; }
+  // Return the last sequence number.  May be called without holding the
+  // DB mutex; every write below the returned sequence is visible.
+  uint64_t LastSequence() const {
+    return last_sequence_.load(std::memory_order_acquire);
+  }
 
   // Set the last sequence number to s.
   void SetLastSequence(uint64_t s) {
-    assert(s >= last_sequence_);
-    last_sequence_ = s;
+    assert(s >= LastSequence());
+    last_sequence_.store(s, std::memory_order_release);
   }
 
   // Mark the specified file number as used.
@@ -227,19 +291,37 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction.  Files that are inputs
+  // of a running compaction are never picked again.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction.  Caller should call ReleaseCompaction()
+  // and then delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
-  // the result.
+  // level that overlaps the specified range.  Caller should call
+  // ReleaseCompaction() and then delete the result.
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Record that the compaction "*c" returned by PickCompaction() or
+  // CompactRange() is no longer running, making its inputs available to
+  // other compactions again.
+  // REQUIRES: c->ReleaseInputs() has not been called yet.
+  void ReleaseCompaction(Compaction* c);
+
+  // Return the number of compactions that have been picked but not
+  // released yet.
+  int NumRunningCompactions() const { return running_compactions_.size(); }
+
+  // Returns true iff some running compaction may add files to "level"
+  // that overlap the user key range [smallest_user_key,largest_user_key].
+  bool RangeBeingCompactedInto(int level, const Slice& smallest_user_key,
+                               const Slice& largest_user_key) const;
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -288,6 +370,15 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Returns true iff "*c" must not run alongside the running compactions:
+  // either it shares an input file with one of them, or both write to
+  // the same level and their key ranges overlap.
+  bool ConflictsWithRunningCompactions(Compaction* c) const;
+
+  // Remember "*c" as a running compaction and advance the compaction
+  // pointer of its level past its inputs.
+  void RegisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -300,7 +391,7 @@ class VersionSet {
   const InternalKeyComparator icmp_;
   uint64_t next_file_number_;
   uint64_t manifest_file_number_;
-  uint64_t last_sequence_;
+  std::atomic<uint64_t> last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -313,6 +404,9 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Compactions that have been picked but not released yet.
+  std::vector<Compaction*> running_compactions_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -349,6 +443,17 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey(), for every user key in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Stop reading the inputs from "level+1" whose whole key range is
+  // covered by one of "tombstones" at a sequence number <= snapshot.
+  // Such files hold only entries older than the tombstones of "level",
+  // so they are deleted by the compaction without being merged.
+  // Returns the number of inputs dropped.
+  int DropCoveredInputs(const std::vector<RangeTombstone>& tombstones,
+                        SequenceNumber snapshot);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -357,6 +462,21 @@ class Compaction {
   // is successful.
   void ReleaseInputs();
 
+  // Choose up to n-1 user keys that split the key range of the inputs
+  // into n pieces holding roughly equal amounts of input data, and store
+  // them in *boundaries in increasing order.  The keys are taken from
+  // the largest keys of the input files.
+  void GetSubcompactionBoundaries(int n,
+                                  std::vector<std::string>* boundaries) const;
+
+  // Return a new compaction over the same inputs, with its own state for
+  // IsBaseLevelForKey() and ShouldStopBefore(), so that disjoint key
+  // ranges of this compaction can be processed in parallel.  The caller
+  // should delete the result.
+  // REQUIRES: ReleaseInputs() has not been called yet.
+  // REQUIRES: the mutex protecting the VersionSet is held.
+  Compaction* NewSubcompaction() const;
+
  private:
   friend class Version;
   friend class VersionSet;
@@ -371,6 +491,16 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
+  // The inputs_[1] files that MakeInputIterator() reads.  Only used
+  // after DropCoveredInputs() has dropped some of them.
+  std::vector<FileMetaData*> inputs_to_read_;
+  bool dropped_covered_inputs_;
+
+  // Range of internal keys covered by the inputs.  Set by
+  // SetupOtherInputs().
+  InternalKey smallest_;
+  InternalKey largest_;
+
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
@@ -37,6 +37,11 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but uses MemTable::AddConcurrently() with the
+  // given slot so that several batches can be inserted in parallel.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable, int slot);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -42,6 +42,22 @@ static std::string PrintContents(WriteBatch* b) {
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      EXPECT_EQ(kTypeRangeDeletion, ikey.type);
+      state.append("DeleteRange(");
+      state.append(ikey.user_key.ToString());
+      state.append(", ");
+      state.append(iter->value().ToString());
+      state.append(")@");
+      state.append(NumberToString(ikey.sequence));
+      count++;
+    }
+    delete iter;
+  }
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -72,6 +88,20 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("c"));
+  batch.Delete(Slice("box"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Delete(box)@102"
+      "Put(foo, bar)@100"
+      "DeleteRange(a, c)@101",
+      PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
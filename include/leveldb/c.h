@@ -86,6 +86,11 @@ LEVELDB_EXPORT void leveldb_delete(leveldb_t* db,
                                    const char* key, size_t keylen,
                                    char** errptr);
 
+LEVELDB_EXPORT void leveldb_delete_range(
+    leveldb_t* db, const leveldb_writeoptions_t* options,
+    const char* begin_key, size_t begin_keylen, const char* end_key,
+    size_t end_keylen, char** errptr);
+
 LEVELDB_EXPORT void leveldb_write(leveldb_t* db,
                                   const leveldb_writeoptions_t* options,
                                   leveldb_writebatch_t* batch, char** errptr);
@@ -120,6 +125,10 @@ LEVELDB_EXPORT void leveldb_compact_range(leveldb_t* db, const char* start_key,
                                           const char* limit_key,
                                           size_t limit_key_len);
 
+LEVELDB_EXPORT void leveldb_delete_files_in_range(
+    leveldb_t* db, const char* start_key, size_t start_key_len,
+    const char* limit_key, size_t limit_key_len, char** errptr);
+
 /* Management operations */
 
 LEVELDB_EXPORT void leveldb_destroy_db(const leveldb_options_t* options,
@@ -155,10 +164,21 @@ LEVELDB_EXPORT void leveldb_writebatch_put(leveldb_writebatch_t*,
                                            const char* val, size_t vlen);
 LEVELDB_EXPORT void leveldb_writebatch_delete(leveldb_writebatch_t*,
                                               const char* key, size_t klen);
+LEVELDB_EXPORT void leveldb_writebatch_delete_range(
+    leveldb_writebatch_t*, const char* begin_key, size_t begin_klen,
+    const char* end_key, size_t end_klen);
+/* Range deletions in the batch are not reported by iterate.  Use
+   iterate_ranges to see them too. */
 LEVELDB_EXPORT void leveldb_writebatch_iterate(
     const leveldb_writebatch_t*, void* state,
     void (*put)(void*, const char* k, size_t klen, const char* v, size_t vlen),
     void (*deleted)(void*, const char* k, size_t klen));
+LEVELDB_EXPORT void leveldb_writebatch_iterate_ranges(
+    const leveldb_writebatch_t*, void* state,
+    void (*put)(void*, const char* k, size_t klen, const char* v, size_t vlen),
+    void (*deleted)(void*, const char* k, size_t klen),
+    void (*deleted_range)(void*, const char* begin_key, size_t begin_klen,
+                          const char* end_key, size_t end_klen));
 LEVELDB_EXPORT void leveldb_writebatch_append(
     leveldb_writebatch_t* destination, const leveldb_writebatch_t* source);
 
@@ -31,6 +31,35 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but reserves up to
+// capacity*high_pri_pool_ratio for entries inserted with
+// Cache::Priority::kHigh.  Such entries are only evicted once no
+// low-priority entry is left to evict, so a stream of low-priority inserts
+// cannot push them out.  Once the high-priority entries outgrow their
+// pool, the least recently used of them are demoted to low priority.
+// REQUIRES: 0 <= high_pri_pool_ratio <= 1
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity and a segmented LRU
+// eviction policy, which resists scans.  New entries start out in a
+// probationary segment and move to a protected segment, of up to 80% of
+// the capacity, when Lookup() finds them.  Entries seen only once, such as
+// the blocks read by a large scan, are evicted before any protected entry.
+// Entries inserted with Cache::Priority::kHigh start out protected.
+LEVELDB_EXPORT Cache* NewSegmentedLRUCache(size_t capacity);
+
+// Create a new cache with a fixed size capacity and a CLOCK eviction
+// policy, split into 2^num_shard_bits shards.  Lookup() and Release() only
+// update atomic counters of the entry, so cache hits never wait for a lock
+// however many threads read at once; Insert() and Erase() lock the shard.
+// The shards have room for about 2*capacity/estimated_entry_charge
+// entries, so if entries are much smaller than estimated, fewer of them
+// fit than the capacity allows.  For a block cache, estimate the block
+// size.
+// REQUIRES: 0 <= num_shard_bits <= 16
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                                    size_t estimated_entry_charge);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +74,9 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Eviction priority of an entry.  See NewLRUCache().
+  enum class Priority { kHigh, kLow };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +89,14 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert(), but with an eviction priority hint.  The default
+  // implementation ignores the hint.
+  virtual Handle* InsertWithPriority(const Slice& key, void* value,
+                                     size_t charge,
+                                     void (*deleter)(const Slice& key,
+                                                     void* value),
+                                     Priority priority);
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
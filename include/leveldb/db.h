@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -72,6 +74,16 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for every key in the range
+  // [begin_key, end_key).  Returns OK on success, and a non-OK status
+  // on error.  It is not an error if the range contains no keys, but
+  // begin_key must not be after end_key.
+  //
+  // The default implementation returns a NotSupported status.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key, const Slice& end_key);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +99,18 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up a batch of keys as of a single consistent state of the DB.
+  // Resizes "*values" to keys.size() and returns one Status per key with
+  // the same semantics as Get(): (*values)[i] holds the value for keys[i]
+  // iff the i-th returned Status is OK.
+  //
+  // Implementations may answer the batch more cheaply than the equivalent
+  // sequence of Get() calls; the default implementation simply calls Get()
+  // for every key.
+  virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                       const std::vector<Slice>& keys,
+                                       std::vector<std::string>* values);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -145,6 +169,38 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Remove the table files whose keys all lie in [*begin,*end] by
+  // dropping them from the database's metadata, without reading or
+  // rewriting any data.  This reclaims disk space for a large range much
+  // faster than deleting its keys, but it is not a full deletion:
+  //  - Keys in the range that are held by the memtable or by files that
+  //    extend past the range remain visible.  Follow up with DeleteRange()
+  //    to remove them.
+  //  - A file is kept if an older file overlapping it is kept, so that
+  //    removing it cannot make older values visible again.
+  //  - Snapshots do not protect the removed data.
+  //
+  // begin==nullptr is treated as a key before all keys in the database.
+  // end==nullptr is treated as a key after all keys in the database.
+  //
+  // The default implementation returns a NotSupported status.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
+
+  // Add the table file "fname", built by SstFileWriter, to the database
+  // without rewriting its contents.  The file is moved into the database
+  // directory, so it must live on the same file system; on success it no
+  // longer exists under "fname".
+  //
+  // All entries of the file are given one new sequence number: they
+  // replace older values of their keys and are not visible to snapshots
+  // taken before the call.  Writes are blocked while the file is added,
+  // and if the memtable holds keys in the file's range it is flushed
+  // first.  The file is placed at the deepest level that no newer data
+  // in its key range lies below.
+  //
+  // The default implementation returns a NotSupported status.
+  virtual Status IngestExternalFile(const std::string& fname);
 };
 
 // Destroy the contents of the specified database.
@@ -110,6 +110,34 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but reads of the returned file bypass the
+  // operating system's page cache where the Env supports that.  Such
+  // reads cost a system call and a copy each.  Returns a NotSupported
+  // status if the file system of fname does not support direct I/O.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but writes to the returned file bypass the
+  // operating system's page cache where the Env supports that.  The data
+  // appended to the file may only reach it on Sync() or Close(); Flush()
+  // may do nothing.  Returns a NotSupported status if the file system of
+  // fname does not support direct I/O.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
+  // Like NewRandomAccessFile(), but the returned file is memory-mapped
+  // where the Env supports that, even if the Env would otherwise read it
+  // with system calls to stay within a limit on the number of mapped
+  // files.  Reads of such a file return pointers into the mapping.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewMmapRandomAccessFile(const std::string& fname,
+                                         RandomAccessFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +225,25 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Background work is divided between two pools of threads so that
+  // short, latency-sensitive work (e.g. memtable flushes) scheduled with
+  // kHigh priority does not queue behind long-running work (e.g.
+  // compactions) scheduled with kLow priority.
+  enum Priority { kLow, kHigh };
+
+  // Like Schedule(), but runs "(*function)(arg)" on the pool for "pri".
+  // Schedule() is equivalent to ScheduleWithPriority(function, arg, kLow).
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority pri);
+
+  // Set the number of threads that run the work scheduled with priority
+  // "pri".  Work that is already running is not interrupted.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -248,9 +295,29 @@ class LEVELDB_EXPORT SequentialFile {
   virtual Status Skip(uint64_t n) = 0;
 };
 
+// One of the reads issued together by RandomAccessFile::MultiRead().
+struct LEVELDB_EXPORT ReadRequest {
+  // Inputs, as for RandomAccessFile::Read().
+  uint64_t offset;
+  size_t n;
+  char* scratch;
+
+  // Outputs, as for RandomAccessFile::Read().
+  Slice result;
+  Status status;
+};
+
 // A file abstraction for randomly reading the contents of a file.
 class LEVELDB_EXPORT RandomAccessFile {
  public:
+  // How a range of the file is going to be read (see Hint()).
+  enum AccessPattern {
+    kNormal,      // No particular order
+    kRandom,      // Small reads at random offsets: do not read ahead
+    kSequential,  // Once, from front to back: read ahead aggressively
+    kWillNeed,    // Soon: start reading the range now
+  };
+
   RandomAccessFile() = default;
 
   RandomAccessFile(const RandomAccessFile&) = delete;
@@ -269,6 +336,25 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Perform reqs[0,num_reqs-1] as if by Read(), setting the result and
+  // status of each request, and return once all of them are done.
+  // Implementations may have the reads in flight at the same time, so
+  // a batch costs about as much as its slowest read rather than the sum
+  // of them.  The default implementation calls Read() for each request
+  // in turn.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void MultiRead(ReadRequest* reqs, size_t num_reqs) const;
+
+  // Tells the implementation that the bytes [offset, offset + n) of the
+  // file, or the rest of the file if "n" is zero, are going to be read
+  // following "pattern", so that it can adjust its caching and readahead
+  // (e.g. with madvise() or posix_fadvise()).  The default implementation
+  // does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual void Hint(uint64_t offset, size_t n, AccessPattern pattern) const;
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -355,6 +441,18 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
+  Status NewMmapRandomAccessFile(const std::string& f,
+                                 RandomAccessFile** r) override {
+    return target_->NewMmapRandomAccessFile(f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -384,6 +482,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority pri) override {
+    return target_->ScheduleWithPriority(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
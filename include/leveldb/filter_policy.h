@@ -67,6 +67,39 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses ribbon filters with about the false
+// positive rate of a bloom filter with the specified number of bits per key,
+// in 20-30% less space.  Building a ribbon filter is a few times
+// slower than building a bloom filter, while lookups cost about the same.
+// For filters over very few keys, where a ribbon filter would not be
+// smaller, a bloom filter is built instead.
+//
+// The policy has the same name as NewBloomFilterPolicy(), and each of them
+// can read the filters created by the other, so a database can switch
+// between the two without rewriting its tables.  Versions of leveldb
+// without ribbon filter support treat ribbon filters as matching every
+// key.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.  The same note about custom comparators as for
+// NewBloomFilterPolicy() applies.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(
+    int bloom_equivalent_bits_per_key);
+
+// Return a new filter policy that uses a bloom filter in which all the
+// bits of a key fall within one 64-byte cache line, with approximately
+// the specified number of bits per key.  Lookups are cheaper than with
+// NewBloomFilterPolicy(), at the cost of a slightly higher false positive
+// rate for the same number of bits per key.  The lines make it a poor fit
+// for the small per-block filters, so it is meant to be used together
+// with Options::full_filter.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.  The same note about custom comparators as for
+// NewBloomFilterPolicy() applies.
+LEVELDB_EXPORT const FilterPolicy* NewCacheLocalBloomFilterPolicy(
+    int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -16,6 +16,8 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -76,12 +78,40 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
-  // Also, a larger write buffer will result in a longer recovery time
-  // the next time the database is opened.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.  Also, a larger write buffer will result in a longer
+  // recovery time the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers (the active memtable plus the full
+  // ones waiting to be written to disk) held in memory at once.  Writes
+  // stall only when the active memtable fills up while this many write
+  // buffers already exist, so larger values absorb longer bursts of
+  // writes at the cost of memory.
+  //
+  // Default: 2, which never queues more than one full write buffer.
+  int max_write_buffer_number = 2;
+
+  // Maximum number of compactions that may run at the same time.  Only
+  // compactions with disjoint inputs and key ranges run concurrently.
+  // Compactions are scheduled on the Env::kLow pool, so the number of
+  // threads in that pool (see Env::SetBackgroundThreads) should be raised
+  // to match.  Memtable flushes are scheduled separately on Env::kHigh.
+  //
+  // Default: 1, which runs one compaction at a time.
+  int max_background_compactions = 1;
+
+  // Maximum number of threads that work on a single compaction.  A large
+  // compaction is split into up to this many pieces at the boundaries of
+  // its input files, and the pieces are compacted in parallel on the
+  // Env::kLow pool, whose number of threads should be raised to match.
+  // Pieces that no pool thread picks up are compacted by the thread
+  // running the compaction.
+  //
+  // Default: 1, which compacts the whole key range on one thread.
+  int max_subcompactions = 1;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -94,6 +124,19 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If true, the index and filter blocks of open tables are kept in
+  // block_cache with high priority instead of being held by the tables
+  // themselves, so block_cache bounds the memory of both.  Give the cache
+  // a high-priority pool (see NewLRUCache()) so that data blocks cannot
+  // evict them.  The internal cache created when block_cache is null has a
+  // pool of half its capacity.
+  bool cache_index_and_filter_blocks = false;
+
+  // If non-null, use the specified cache for the results of point lookups
+  // in table files, so that lookups of hot keys skip the tables.  Charges
+  // are roughly the sizes of the keys and values.
+  Cache* row_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -105,6 +148,70 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If true, each data block ends with a small hash table that maps the
+  // user keys in the block to their restart points.  Get() then goes
+  // straight to the entry it is looking for instead of binary searching
+  // the restart points, and gives up at once when the block does not hold
+  // the key.  It costs a little over one byte per distinct user key, and
+  // is only added to blocks with at most 253 restart points.
+  //
+  // Tables written with this option cannot be read by versions of leveldb
+  // that predate it.  Tables written without it stay readable either way.
+  bool data_block_hash_index = false;
+
+  // If true, the index of each table is split into partitions of about
+  // metadata_block_size bytes that are read through the block cache like
+  // data blocks, and only a small top-level index stays in memory while
+  // the table is open.  If a filter policy is set, the filters are split
+  // the same way: every index partition gets one filter over the keys of
+  // its data blocks (full_filter is then ignored).  This keeps the memory
+  // of open tables in check when max_file_size is large.
+  //
+  // Tables written with this option cannot be read by versions of leveldb
+  // that predate it.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of an index partition when
+  // partition_index_and_filters is set.
+  size_t metadata_block_size = 4 * 1024;
+
+  // Compactions read each of their input tables in windows of this many
+  // bytes instead of one block at a time, which issues far fewer reads
+  // on storage where every read has a high latency.  If zero, compaction
+  // inputs read ahead like the iterators of ReadOptions::readahead_size.
+  size_t compaction_readahead_size = 2 * 1024 * 1024;
+
+  // If true, table files are read with direct I/O (O_DIRECT), which
+  // bypasses the operating system's page cache.  Blocks are then only
+  // cached by block_cache, which should be given the memory that the page
+  // cache would have used.  Needs an Env that supports direct I/O (see
+  // Env::NewDirectRandomAccessFile); others read through the page cache.
+  // Reads of table files on a file system without direct I/O (e.g. tmpfs)
+  // fail with a NotSupported status that names this option.
+  //
+  // Default: false
+  bool use_direct_reads = false;
+
+  // If true, the table files written by memtable flushes and compactions
+  // are written with direct I/O, so that they do not push hot pages out of
+  // the page cache.  The log and the MANIFEST are still written through
+  // the page cache.  On a file system without direct I/O, flushes and
+  // compactions fail with a NotSupported status that names this option.
+  //
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction = false;
+
+  // If true, every table file is memory-mapped (see
+  // Env::NewMmapRandomAccessFile), however many there are.  Uncompressed
+  // blocks are then read in place, without being copied or kept in
+  // block_cache.  Tables are advised to be read at random, while
+  // compactions and iterators that read ahead advise the ranges they are
+  // about to read.  This suits databases that fit in memory and are read
+  // far more than they are written.  Ignored if use_direct_reads is set.
+  //
+  // Default: false
+  bool use_mmap_reads = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -141,10 +248,44 @@ struct LEVELDB_EXPORT Options {
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, the write path is split into two pipelined stages: a group
+  // of writes may append to the log while the previous group is still
+  // being inserted into the memtable.  Writes still become visible in
+  // the order in which they were logged.  This mostly helps workloads
+  // with many concurrent writers.
+  //
+  // Default: false
+  bool enable_pipelined_write = false;
+
+  // If true, each writer in a write group inserts its own batch into the
+  // memtable, in parallel with the rest of the group, instead of the
+  // group leader inserting every entry by itself.  This helps when many
+  // threads write concurrently and memtable inserts dominate the cost of
+  // a write.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write = false;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, each table stores a single filter for all of its keys
+  // instead of one filter for every 2KB of data.  A lookup then probes
+  // one filter without first locating the filter of its data block.
+  // Tables written with either setting remain readable.
+  //
+  // Default: false
+  bool full_filter = false;
+
+  // If non-null, use the specified transformation to extract a prefix
+  // from every key.  When filter_policy is also set, the filters then
+  // contain the prefixes of the keys as well, which lets iterators that
+  // read with ReadOptions::prefix_same_as_start skip blocks and tables
+  // that do not contain the prefix they are looking for.  Many
+  // applications will pass the result of NewFixedPrefixTransform() here.
+  const SliceTransform* prefix_extractor = nullptr;
 };
 
 // Options that control read operations
@@ -157,11 +298,39 @@ struct LEVELDB_EXPORT ReadOptions {
   // Callers may wish to set this field to false for bulk scans.
   bool fill_cache = true;
 
+  // If non-zero, an iterator reads each table in windows of this many
+  // bytes, and serves the data blocks that follow from memory.  If zero,
+  // an iterator starts to read ahead on its own after a few blocks read
+  // one after the other, with windows that grow from 8KB to 256KB.
+  // Point lookups never read ahead.
+  size_t readahead_size = 0;
+
   // If "snapshot" is non-null, read as of the supplied snapshot
   // (which must belong to the DB that is being read and which must
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and the DB has a prefix_extractor, an iterator positioned by
+  // Seek() only yields the entries whose keys share the prefix of the
+  // target, and becomes invalid after the last of them.  Blocks and
+  // tables whose filters rule the prefix out are not read.  Targets that
+  // are not in the domain of the prefix_extractor are not restricted.
+  // SeekToLast() and Prev() are not supported on such an iterator.
+  bool prefix_same_as_start = false;
+
+  // If non-null, a DB iterator only yields the keys at or after
+  // "*iterate_lower_bound", and does not read the blocks and tables that
+  // lie entirely before it.  Seek() targets before the bound behave like
+  // a Seek() to the bound.  The slice must stay live while the iterator
+  // is in use.
+  const Slice* iterate_lower_bound = nullptr;
+
+  // If non-null, a DB iterator only yields the keys before
+  // "*iterate_upper_bound" (which is excluded), and does not read the
+  // blocks and tables that lie entirely after it.  The slice must stay
+  // live while the iterator is in use.
+  const Slice* iterate_upper_bound = nullptr;
 };
 
 // Options that control write operations
@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a SliceTransform that extracts a
+// prefix from every key.  When a filter policy is also configured, the
+// filters of each table then summarize the prefixes of its keys as well
+// as the keys themselves, so that an iterator that is only interested in
+// the keys sharing a prefix (see ReadOptions::prefix_same_as_start) can
+// skip the blocks and tables that do not contain that prefix.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transformation.  The name is recorded in
+  // every table whose filters contain prefixes, so it must be changed
+  // if the transformation changes in an incompatible way.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a prefix of "key"
+  // (i.e. it must point into the same memory), and all keys that share
+  // a prefix must be adjacent in the order defined by the comparator.
+  //
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true if Transform() may be applied to "key".  Keys outside
+  // of the domain are not added to the filters as prefixes.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transformation whose prefix is the first "prefix_len"
+// bytes of a key.  Keys shorter than "prefix_len" are not in its domain.
+// Only suitable for comparators that order keys bytewise.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
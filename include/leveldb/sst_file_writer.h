@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, which can
+// later be added to a database with DB::IngestExternalFile().
+//
+// An SstFileWriter is not thread-safe: all threads accessing the same
+// SstFileWriter must use external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // Create a writer for tables that will be ingested into a database
+  // opened with "options".  The comparator, filter policy, block and
+  // compression settings of "options" are used to build the table.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // If Finish() has not been called, the file being built is abandoned
+  // and deleted.
+  ~SstFileWriter();
+
+  // Start building a new table in the file named "fname", replacing any
+  // existing file of that name.
+  // REQUIRES: Open() has not been called yet.
+  Status Open(const std::string& fname);
+
+  // Add an entry that maps "key" to "value".
+  // REQUIRES: key is after any previously added key according to the
+  // comparator.  Returns InvalidArgument otherwise.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add an entry that deletes "key" from the database the file is
+  // ingested into.
+  // REQUIRES: key is after any previously added key according to the
+  // comparator.  Returns InvalidArgument otherwise.
+  Status Delete(const Slice& key);
+
+  // Finish building the table, and sync and close the file.  At least
+  // one entry must have been added.
+  Status Finish();
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final generated file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, int type, const Slice& value);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
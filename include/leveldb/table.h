@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
@@ -17,6 +18,7 @@ class BlockHandle;
 class Footer;
 struct Options;
 class RandomAccessFile;
+class ReadaheadBuffer;
 struct ReadOptions;
 class TableCache;
 
@@ -64,8 +66,46 @@ class LEVELDB_EXPORT Table {
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Like BlockReader(), for index partitions.
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  // Does the work of BlockReader() and IndexPartitionReader().  If
+  // "point_lookup" is true, the result is only meant for a single Seek()
+  // to the entries of one user key, which may then use the hash index of
+  // the block.  If "index" is true, the block is part of the index and is
+  // cached like one.  If "readahead" is non-null, a block missing from the
+  // cache is read through it.
+  Iterator* BlockIterator(const ReadOptions&, const Slice& index_value,
+                          bool point_lookup, bool index,
+                          ReadaheadBuffer* readahead) const;
+
+  // The may_match_function of the iterators returned by NewIterator().
+  static bool BlockMayMatch(void*, const Slice& index_value,
+                            const Slice& target);
+
+  // Returns false if the filter of the block at "index_value" shows that
+  // the block has no key sharing the prefix of "target".
+  bool BlockPrefixMayMatch(const Slice& index_value,
+                           const Slice& target) const;
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
+  // Returns an iterator over the index entries of the data blocks, which
+  // reads the index partitions if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Returns false if the filter of the data block at "index_value" shows
+  // that "key" was not added to it.
+  bool FilterMayMatch(const ReadOptions&, const Slice& index_value,
+                      const Slice& key) const;
+
+  // Like FilterMayMatch(), with the filter at "filter_handle" read through
+  // the block cache.
+  bool CachedFilterMayMatch(const ReadOptions&, const BlockHandle& filter_handle,
+                            bool full, uint64_t block_offset,
+                            const Slice& key) const;
+
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
@@ -73,8 +113,25 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  // Finds the data blocks that InternalGet() of each of "keys" would read
+  // and reads the ones missing from the block cache with a single
+  // RandomAccessFile::MultiRead(), adding them to the cache.  Sets
+  // (*may_match)[i] to false if the index or filter shows that the table
+  // has no entry for keys[i].
+  void Prefetch(const ReadOptions&, const std::vector<Slice>& keys,
+                std::vector<bool>* may_match) const;
+
+  // Returns an iterator over the range tombstones of the table, or
+  // nullptr if it has none.  Keys are encoded tombstone start keys and
+  // values are end keys.
+  Iterator* NewRangeTombstoneIterator() const;
+
+  // Returns false if the filters show that the table has no key that
+  // shares the prefix of "target" and is not before "target".
+  bool PrefixMayMatch(const Slice& target) const;
+
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
 
   Rep* const rep_;
 };
@@ -51,6 +51,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table being constructed.  "key" is the
+  // encoded tombstone start key and "value" its end key; tombstones are
+  // kept in a meta block apart from the entries passed to Add().
+  // REQUIRES: key is after any previously added tombstone key according
+  // to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -75,12 +83,17 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
+  // Number of calls to AddRangeTombstone() so far.
+  uint64_t NumRangeTombstones() const;
+
   // Size of the file generated so far.  If invoked after a successful
   // Finish() call, returns the size of the final generated file.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
+  void AddIndexEntry(const Slice& key, const BlockHandle& handle);
+  void WriteIndexPartitions();
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
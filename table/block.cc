@@ -17,25 +17,41 @@
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      num_restarts_(0),
+      hash_offset_(0),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  size_t limit = size_ - sizeof(uint32_t);
+  num_restarts_ = DecodeFixed32(data_ + limit);
+  if ((num_restarts_ & kHashIndexFlag) != 0) {
+    num_restarts_ &= ~kHashIndexFlag;
+    if (limit < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    limit -= sizeof(uint32_t);
+    num_buckets_ = DecodeFixed32(data_ + limit);
+    if (num_buckets_ == 0 || num_buckets_ > limit) {
+      // The size is too small for the hash buckets
+      size_ = 0;
+      return;
+    }
+    limit -= num_buckets_;
+    hash_offset_ = limit;
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for the restart array
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -80,6 +96,8 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const uint8_t* const buckets_;  // Hash index, or nullptr if not to be used
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +132,13 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const uint8_t* buckets, uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        buckets_(buckets),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +182,29 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    if (buckets_ != nullptr && target.size() >= 8) {
+      // The hash index is keyed on user keys, i.e. internal keys without
+      // their 8 byte sequence number and type.
+      const Slice user_key(target.data(), target.size() - 8);
+      const uint8_t entry =
+          buckets_[Block::HashIndexHash(user_key) % num_buckets_];
+      if (entry == Block::kHashNoEntry) {
+        // No entry of the block has this user key
+        MarkInvalid();
+        return;
+      }
+      if (entry < num_restarts_) {
+        // The restart interval "entry" holds the first entry of the user
+        // key, so every entry before that one is smaller than "target".
+        SeekToRestartPoint(entry);
+        while (ParseNextKey() && Compare(key_, target) < 0) {
+          // Keep skipping
+        }
+        return;
+      }
+      // Several user keys share the bucket: fall back to binary search
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -239,14 +282,18 @@ class Block::Iter : public Iterator {
   }
 
  private:
-  void CorruptionError() {
+  void MarkInvalid() {
     current_ = restarts_;
     restart_index_ = num_restarts_;
-    status_ = Status::Corruption("bad entry in block");
     key_.clear();
     value_.clear();
   }
 
+  void CorruptionError() {
+    MarkInvalid();
+    status_ = Status::Corruption("bad entry in block");
+  }
+
   bool ParseNextKey() {
     current_ = NextEntryOffset();
     const char* p = data_ + current_;
@@ -277,15 +324,20 @@ class Block::Iter : public Iterator {
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator,
+                             bool point_lookup) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    const bool use_hash = point_lookup && num_buckets_ > 0;
+    return new Iter(comparator, data_, restart_offset_, num_restarts_,
+                    use_hash ? reinterpret_cast<const uint8_t*>(data_) +
+                                   hash_offset_
+                             : nullptr,
+                    num_buckets_);
   }
 }
 
@@ -9,6 +9,8 @@
 #include <cstdint>
 
 #include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -26,16 +28,34 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // If "point_lookup" is true, Seek() on the result is only meant to find
+  // the entries of the user key of an internal key target.  It may use the
+  // hash index of the block, and then leaves the iterator invalid when the
+  // block holds no entry for that user key.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool point_lookup = false);
+
+  // Layout of the optional hash index at the end of a data block, see
+  // block_builder.cc.
+  static const uint32_t kHashIndexFlag = 1u << 31;
+  static const uint8_t kHashNoEntry = 255;
+  static const uint8_t kHashCollision = 254;
+  static const uint32_t kHashMaxRestarts = 253;
+
+  static uint32_t HashIndexHash(const Slice& user_key) {
+    return Hash(user_key.data(), user_key.size(), 0x3c2b0a19);
+  }
 
  private:
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  uint32_t num_restarts_;
+  uint32_t hash_offset_;     // Offset in data_ of hash buckets
+  uint32_t num_buckets_;     // 0 if the block has no hash index
   bool owned_;               // Block owns data_[]
 };
 
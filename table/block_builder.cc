@@ -25,6 +25,18 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options.data_block_hash_index is set, the keys are internal keys
+// and the block has at most Block::kHashMaxRestarts restart points, the
+// restart array is followed by a hash index and the trailer becomes:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | Block::kHashIndexFlag: uint32
+// Each user key is hashed into one of the buckets, which holds the index
+// of the restart point whose interval contains the first entry of the
+// user key.  Buckets no user key hashes into hold kHashNoEntry, and
+// buckets that different restart points hash into hold kHashCollision.
 
 #include "table/block_builder.h"
 
@@ -33,6 +45,7 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/block.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -50,11 +63,22 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_entries_.clear();
+}
+
+// Use a bucket for every 0.75 distinct user keys.
+static size_t NumHashBuckets(size_t num_entries) {
+  return num_entries * 4 / 3 + 1;
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  size_t hash_index = 0;
+  if (!hash_entries_.empty()) {
+    hash_index = NumHashBuckets(hash_entries_.size()) + sizeof(uint32_t);
+  }
   return (buffer_.size() +                       // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +  // Restart array
+          hash_index +                           // Hash index
           sizeof(uint32_t));                     // Restart array length
 }
 
@@ -63,7 +87,24 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  if (hash_entries_.empty() || restarts_.size() > Block::kHashMaxRestarts) {
+    PutFixed32(&buffer_, restarts_.size());
+  } else {
+    // Append hash index
+    const size_t num_buckets = NumHashBuckets(hash_entries_.size());
+    std::string buckets(num_buckets, static_cast<char>(Block::kHashNoEntry));
+    for (const auto& entry : hash_entries_) {
+      char& bucket = buckets[entry.first % num_buckets];
+      if (bucket == static_cast<char>(Block::kHashNoEntry)) {
+        bucket = static_cast<char>(entry.second);
+      } else if (bucket != static_cast<char>(entry.second)) {
+        bucket = static_cast<char>(Block::kHashCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    PutFixed32(&buffer_, restarts_.size() | Block::kHashIndexFlag);
+  }
   finished_ = true;
   return Slice(buffer_);
 }
@@ -88,6 +129,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (options_->data_block_hash_index && key.size() >= 8) {
+    // Entries of the same user key are adjacent, so only the first of
+    // them is recorded.
+    const Slice user_key(key.data(), key.size() - 8);
+    if (buffer_.empty() || last_key_piece.size() < 8 ||
+        Slice(last_key_piece.data(), last_key_piece.size() - 8) != user_key) {
+      hash_entries_.emplace_back(Block::HashIndexHash(user_key),
+                                 restarts_.size() - 1);
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -47,6 +49,10 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  // Hash of each distinct user key and the restart point of its first
+  // entry, for the hash index (see Options::data_block_hash_index)
+  std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
 };
 
 }  // namespace leveldb
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,10 +16,13 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       const SliceTransform* prefix_extractor,
+                                       bool full)
+    : policy_(policy), prefix_extractor_(prefix_extractor), full_(full) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_) return;  // All keys go into the one filter
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -27,6 +31,13 @@ void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
 }
 
 void FilterBlockBuilder::AddKey(const Slice& key) {
+  AppendKey(key);
+  if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(key)) {
+    AppendKey(prefix_extractor_->Transform(key));
+  }
+}
+
+void FilterBlockBuilder::AppendKey(const Slice& key) {
   Slice k = key;
   start_.push_back(keys_.size());
   keys_.append(k.data(), k.size());
@@ -36,6 +47,11 @@ Slice FilterBlockBuilder::Finish() {
   if (!start_.empty()) {
     GenerateFilter();
   }
+  if (full_) {
+    // A full filter block is just the filter itself, which is empty if
+    // the table has no keys.
+    return Slice(result_);
+  }
 
   // Append array of per-filter offsets
   const uint32_t array_offset = result_.size();
@@ -75,8 +91,17 @@ void FilterBlockBuilder::GenerateFilter() {
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
-                                     const Slice& contents)
-    : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
+                                     const Slice& contents, bool full)
+    : policy_(policy),
+      full_(full),
+      data_(nullptr),
+      offset_(nullptr),
+      num_(0),
+      base_lg_(0) {
+  if (full_) {
+    full_filter_ = contents;
+    return;
+  }
   size_t n = contents.size();
   if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
   base_lg_ = contents[n - 1];
@@ -88,6 +113,10 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  if (full_) {
+    // An empty full filter belongs to a table without keys
+    return !full_filter_.empty() && policy_->KeyMayMatch(key, full_filter_);
+  }
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
@@ -20,6 +20,7 @@
 namespace leveldb {
 
 class FilterPolicy;
+class SliceTransform;
 
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
@@ -27,9 +28,15 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// If a prefix extractor is supplied, the prefix of every key in its
+// domain is added to the filters along with the key itself.  If "full"
+// is true, the block is a single filter for all of the keys instead.
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*,
+                              const SliceTransform* prefix_extractor = nullptr,
+                              bool full = false);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -40,8 +47,11 @@ class FilterBlockBuilder {
 
  private:
   void GenerateFilter();
+  void AppendKey(const Slice& key);
 
   const FilterPolicy* policy_;
+  const SliceTransform* prefix_extractor_;
+  const bool full_;
   std::string keys_;             // Flattened key contents
   std::vector<size_t> start_;    // Starting index in keys_ of each key
   std::string result_;           // Filter data computed so far
@@ -52,11 +62,15 @@ class FilterBlockBuilder {
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  // "full" must match the setting the block was built with.
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool full = false);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
  private:
   const FilterPolicy* policy_;
+  Slice full_filter_;   // The whole filter if the block is a full filter
+  bool full_;
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
@@ -6,6 +6,7 @@
 
 #include "gtest/gtest.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -71,6 +72,24 @@ TEST_F(FilterBlockTest, SingleChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(100, "other"));
 }
 
+TEST_F(FilterBlockTest, Prefixes) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(3);
+  FilterBlockBuilder builder(&policy_, prefix_extractor);
+  builder.StartBlock(100);
+  builder.AddKey("foo1");
+  builder.AddKey("bar2");
+  builder.AddKey("hi");
+  Slice block = builder.Finish();
+  FilterBlockReader reader(&policy_, block);
+  ASSERT_TRUE(reader.KeyMayMatch(100, "foo1"));
+  ASSERT_TRUE(reader.KeyMayMatch(100, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(100, "bar"));
+  ASSERT_TRUE(reader.KeyMayMatch(100, "hi"));
+  ASSERT_TRUE(!reader.KeyMayMatch(100, "fo"));
+  ASSERT_TRUE(!reader.KeyMayMatch(100, "baz"));
+  delete prefix_extractor;
+}
+
 TEST_F(FilterBlockTest, MultiChunk) {
   FilterBlockBuilder builder(&policy_);
 
@@ -4,10 +4,13 @@
 
 #include "table/format.h"
 
+#include <vector>
+
 #include "leveldb/env.h"
 #include "leveldb/options.h"
 #include "port/port.h"
 #include "table/block.h"
+#include "table/readahead_buffer.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -34,8 +37,10 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  const uint64_t magic =
+      partitioned_index_ ? kPartitionedTableMagicNumber : kTableMagicNumber;
+  PutFixed32(dst, static_cast<uint32_t>(magic & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic >> 32));
   assert(dst->size() == original_size + kEncodedLength);
   (void)original_size;  // Disable unused variable warning.
 }
@@ -50,9 +55,10 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber && magic != kPartitionedTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  partitioned_index_ = (magic == kPartitionedTableMagicNumber);
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -66,22 +72,13 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
-                 const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
+// Check and uncompress the block identified by "handle", given what a read
+// of its contents and trailer into the array "buf" returned in "contents".
+// Takes ownership of "buf".
+static Status FinishBlock(const ReadOptions& options, const BlockHandle& handle,
+                          char* buf, const Slice& contents,
+                          BlockContents* result) {
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
@@ -94,8 +91,7 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -161,4 +157,57 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, BlockContents* result) {
+  return ReadBlock(file, nullptr, options, handle, result);
+}
+
+Status ReadBlock(RandomAccessFile* file, ReadaheadBuffer* readahead,
+                 const ReadOptions& options, const BlockHandle& handle,
+                 BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  size_t n = static_cast<size_t>(handle.size());
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  Status s =
+      readahead != nullptr
+          ? readahead->Read(file, handle.offset(), n + kBlockTrailerSize,
+                            &contents, buf)
+          : file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  return FinishBlock(options, handle, buf, contents, result);
+}
+
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, size_t num_blocks,
+                BlockContents* results, Status* statuses) {
+  std::vector<ReadRequest> reqs(num_blocks);
+  for (size_t i = 0; i < num_blocks; i++) {
+    reqs[i].offset = handles[i].offset();
+    reqs[i].n = static_cast<size_t>(handles[i].size()) + kBlockTrailerSize;
+    reqs[i].scratch = new char[reqs[i].n];
+  }
+  file->MultiRead(reqs.data(), num_blocks);
+  for (size_t i = 0; i < num_blocks; i++) {
+    results[i].data = Slice();
+    results[i].cachable = false;
+    results[i].heap_allocated = false;
+    if (!reqs[i].status.ok()) {
+      delete[] reqs[i].scratch;
+      statuses[i] = reqs[i].status;
+    } else {
+      statuses[i] = FinishBlock(options, handles[i], reqs[i].scratch,
+                                reqs[i].result, &results[i]);
+    }
+  }
+}
+
 }  // namespace leveldb
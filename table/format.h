@@ -16,6 +16,7 @@ namespace leveldb {
 
 class Block;
 class RandomAccessFile;
+class ReadaheadBuffer;
 struct ReadOptions;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
@@ -62,12 +63,20 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index block is the top level of a partitioned index,
+  // i.e. its entries point at index partitions rather than data blocks.
+  // Recorded in the magic number, so that readers that do not know about
+  // partitioned indexes reject the table.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,6 +84,9 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of the tables with a partitioned index.
+static const uint64_t kPartitionedTableMagicNumber = 0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -89,6 +101,18 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Like the above, but reads the block through "readahead".
+Status ReadBlock(RandomAccessFile* file, ReadaheadBuffer* readahead,
+                 const ReadOptions& options, const BlockHandle& handle,
+                 BlockContents* result);
+
+// Read the blocks identified by handles[0,num_blocks-1] from "file" with
+// one RandomAccessFile::MultiRead(), filling results[i] and statuses[i]
+// as ReadBlock() would for handles[i].
+void ReadBlocks(RandomAccessFile* file, const ReadOptions& options,
+                const BlockHandle* handles, size_t num_blocks,
+                BlockContents* results, Status* statuses);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
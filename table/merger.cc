@@ -4,6 +4,8 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -22,6 +24,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -32,24 +35,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void Next() override {
@@ -72,10 +75,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      // current_ is still the smallest child, so it stays on top.
+      BuildHeap();
     }
 
     current_->Next();
-    FindSmallest();
+    ReplaceTop();
   }
 
   void Prev() override {
@@ -101,10 +106,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      // current_ is still the largest child, so it stays on top.
+      BuildHeap();
     }
 
     current_->Prev();
-    FindLargest();
+    ReplaceTop();
   }
 
   Slice key() const override {
@@ -132,47 +139,83 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Returns true iff child "a" should be yielded before child "b" in the
+  // current direction.  Ties go to the child with the lower index when
+  // moving forward and to the one with the higher index in reverse.
+  bool Before(IteratorWrapper* a, IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Rebuild heap_ from the valid children and point current_ at its top.
+  void BuildHeap();
+
+  // Restore the heap property after the child at the top of heap_ has
+  // moved, dropping it from heap_ if it is no longer valid.
+  void ReplaceTop();
+
+  void SiftDown(size_t i);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
   Direction direction_;
+
+  // The valid children, arranged as a binary heap whose top (heap_[0]) is
+  // the child to yield next in the current direction: the smallest key
+  // when moving forward, and the largest in reverse.  Each step costs
+  // O(log n) comparisons instead of O(n).
+  std::vector<IteratorWrapper*> heap_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::ReplaceTop() {
+  assert(!heap_.empty() && heap_[0] == current_);
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty()) {
+    SiftDown(0);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t i) {
+  const size_t size = heap_.size();
+  IteratorWrapper* const child = heap_[i];
+  while (true) {
+    size_t best = 2 * i + 1;
+    if (best >= size) {
+      break;
+    }
+    if (best + 1 < size && Before(heap_[best + 1], heap_[best])) {
+      best++;
+    }
+    if (!Before(heap_[best], child)) {
+      break;
     }
+    heap_[i] = heap_[best];
+    i = best;
   }
-  current_ = largest;
+  heap_[i] = child;
 }
 }  // namespace
 
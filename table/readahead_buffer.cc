@@ -0,0 +1,110 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/readahead_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+ReadaheadBuffer::ReadaheadBuffer(size_t readahead_size, uint64_t file_size)
+    : adaptive_(readahead_size == 0),
+      max_size_(readahead_size == 0 ? kMaxAutoSize : readahead_size),
+      file_size_(file_size),
+      in_place_(false),
+      window_(readahead_size == 0 ? kInitialAutoSize : readahead_size),
+      sequential_reads_(0),
+      next_offset_(~static_cast<uint64_t>(0)),
+      buf_(nullptr),
+      capacity_(0),
+      buf_offset_(0),
+      buf_len_(0) {}
+
+ReadaheadBuffer::~ReadaheadBuffer() { delete[] buf_; }
+
+Status ReadaheadBuffer::Read(RandomAccessFile* file, uint64_t offset,
+                             size_t n, Slice* result, char* scratch) {
+  if (offset >= buf_offset_ && offset + n <= buf_offset_ + buf_len_) {
+    next_offset_ = offset + n;
+    if (in_place_) {
+      return file->Read(offset, n, result, scratch);
+    }
+    std::memcpy(scratch, buf_ + (offset - buf_offset_), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  if (offset == next_offset_) {
+    sequential_reads_++;
+  } else {
+    sequential_reads_ = 0;
+    if (adaptive_) {
+      window_ = kInitialAutoSize;
+    }
+  }
+  next_offset_ = offset + n;
+  size_t window = window_;
+  if (offset < file_size_ && file_size_ - offset < window) {
+    window = static_cast<size_t>(file_size_ - offset);
+  }
+  if ((adaptive_ && sequential_reads_ < kSequentialReads) || window <= n) {
+    return file->Read(offset, n, result, scratch);
+  }
+
+  if (in_place_) {
+    StartWindow(file, offset, window);
+    return file->Read(offset, n, result, scratch);
+  }
+
+  if (capacity_ < window) {
+    delete[] buf_;
+    buf_ = new char[window];
+    capacity_ = window;
+  }
+  buf_len_ = 0;
+  Slice data;
+  Status s = file->Read(offset, window, &data, buf_);
+  if (!s.ok()) {
+    return s;
+  }
+  if (data.data() != buf_) {
+    // Reading ahead into memory gains nothing for this file.
+    in_place_ = true;
+    delete[] buf_;
+    buf_ = nullptr;
+    capacity_ = 0;
+    StartWindow(file, offset, data.size());
+    *result = Slice(data.data(), std::min(n, data.size()));
+    return s;
+  }
+  buf_offset_ = offset;
+  buf_len_ = data.size();
+  GrowWindow();
+
+  n = std::min(n, buf_len_);
+  std::memcpy(scratch, buf_, n);
+  *result = Slice(scratch, n);
+  return s;
+}
+
+void ReadaheadBuffer::StartWindow(RandomAccessFile* file, uint64_t offset,
+                                  size_t size) {
+  file->Hint(offset, size,
+             adaptive_ ? RandomAccessFile::kWillNeed
+                       : RandomAccessFile::kSequential);
+  buf_offset_ = offset;
+  buf_len_ = size;
+  GrowWindow();
+}
+
+void ReadaheadBuffer::GrowWindow() {
+  if (adaptive_) {
+    window_ = std::min(2 * window_, max_size_);
+  }
+}
+
+}  // namespace leveldb
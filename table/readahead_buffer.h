@@ -0,0 +1,86 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_READAHEAD_BUFFER_H_
+#define STORAGE_LEVELDB_TABLE_READAHEAD_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class RandomAccessFile;
+
+// Serves the block reads of one table iterator.  Such an iterator mostly
+// walks the table from front to back, one block at a time, so instead of
+// issuing one small read per block, a read that continues where the
+// previous one ended fetches a larger window of the file, and the reads
+// that follow are served from memory.  Reads elsewhere in the file go
+// straight to the file and restart the detection of sequential access.
+//
+// Files that return their data in place (e.g. mmap-ed files) are not
+// copied into the buffer.  The windows are instead passed to
+// RandomAccessFile::Hint(), as kSequential if the buffer has a fixed
+// size, and as kWillNeed otherwise.
+//
+// Not thread-safe: every iterator owns its buffer.
+class ReadaheadBuffer {
+ public:
+  // Number of sequential reads that must go to the file before an
+  // adaptive buffer starts to read ahead.
+  static const int kSequentialReads = 2;
+
+  // Size of the first window of an adaptive buffer.  Every window that
+  // follows is twice as large as the previous one, up to kMaxAutoSize.
+  static const size_t kInitialAutoSize = 8 * 1024;
+  static const size_t kMaxAutoSize = 256 * 1024;
+
+  // If "readahead_size" is zero, the buffer starts to read ahead on its
+  // own once it sees sequential reads.  Otherwise every read that misses
+  // the buffer fetches "readahead_size" bytes.  Windows never extend past
+  // "file_size", the size of the file being read.
+  ReadaheadBuffer(size_t readahead_size, uint64_t file_size);
+
+  ReadaheadBuffer(const ReadaheadBuffer&) = delete;
+  ReadaheadBuffer& operator=(const ReadaheadBuffer&) = delete;
+
+  ~ReadaheadBuffer();
+
+  // Like file->Read(offset, n, result, scratch).  *result may point into
+  // scratch or into memory owned by "file", but never into the buffer.
+  Status Read(RandomAccessFile* file, uint64_t offset, size_t n,
+              Slice* result, char* scratch);
+
+ private:
+  // Makes [offset, offset + size) the current window of a file that is
+  // read in place, and hints that it is about to be read.
+  void StartWindow(RandomAccessFile* file, uint64_t offset, size_t size);
+
+  // Doubles the size of the next window of an adaptive buffer.
+  void GrowWindow();
+
+  const bool adaptive_;
+  const size_t max_size_;
+  const uint64_t file_size_;
+
+  // Set once the file turns out to return its data without copying it
+  // to the scratch space, after which the window is only hinted.
+  bool in_place_;
+
+  size_t window_;            // Bytes to read on the next miss
+  int sequential_reads_;     // Reads in a row that went to next_offset_
+  uint64_t next_offset_;     // End of the previous read
+
+  char* buf_;
+  size_t capacity_;          // Allocated size of buf_
+  uint64_t buf_offset_;      // File offset of the current window
+  size_t buf_len_;           // Size of the current window
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_READAHEAD_BUFFER_H_
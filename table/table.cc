@@ -4,14 +4,19 @@
 
 #include "leveldb/table.h"
 
+#include <set>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/readahead_buffer.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -22,19 +27,73 @@ struct Table::Rep {
     delete filter;
     delete[] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
+  uint64_t file_size;
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  bool prefix_filtered;  // Whether filter also holds the key prefixes
+
+  // Whether the index entries point at filter partitions, which are read
+  // through the block cache (see Options::partition_index_and_filters).
+  bool partitioned_filter;
+
+  // Set instead of filter when the filter is kept in the block cache (see
+  // Options::cache_index_and_filter_blocks).
+  bool filter_cached;
+  bool filter_full;
+  BlockHandle filter_handle;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  bool partitioned_index;        // index_block points at index partitions
+
+  // nullptr if the index block is kept in the block cache instead.
   Block* index_block;
+  std::string index_handle;  // Encoded handle of the index block
+  Block* range_del_block;    // nullptr if the table has no range tombstones
 };
 
+static void DeleteBlock(void* arg, void* ignored) {
+  delete reinterpret_cast<Block*>(arg);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+  Block* block = reinterpret_cast<Block*>(value);
+  delete block;
+}
+
+// Index and filter blocks, including the partitions of partitioned ones, get
+// the high priority pool of the block cache if the option asks for it.
+static Cache::Priority MetaBlockPriority(const Options& options) {
+  return options.cache_index_and_filter_blocks ? Cache::Priority::kHigh
+                                               : Cache::Priority::kLow;
+}
+
+// A filter held by the block cache
+namespace {
+struct CachedFilter {
+  CachedFilter(const FilterPolicy* policy, const BlockContents& contents,
+               bool full)
+      : reader(policy, contents.data, full),
+        owned_data(contents.heap_allocated ? contents.data.data() : nullptr),
+        size(contents.data.size()) {}
+  ~CachedFilter() { delete[] owned_data; }
+
+  FilterBlockReader reader;
+  const char* owned_data;
+  size_t size;
+};
+}  // namespace
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -67,23 +126,43 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     Rep* rep = new Table::Rep;
     rep->options = options;
     rep->file = file;
+    rep->file_size = size;
     rep->metaindex_handle = footer.metaindex_handle();
+    rep->partitioned_index = footer.partitioned_index();
     rep->index_block = index_block;
+    footer.index_handle().EncodeTo(&rep->index_handle);
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->prefix_filtered = false;
+    rep->partitioned_filter = false;
+    rep->filter_cached = false;
+    rep->filter_full = false;
+    rep->range_del_block = nullptr;
+    if (options.cache_index_and_filter_blocks &&
+        options.block_cache != nullptr && index_block_contents.cachable) {
+      // Hand the index block over to the block cache
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, rep->cache_id);
+      EncodeFixed64(cache_key_buffer + 8, footer.index_handle().offset());
+      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      options.block_cache->Release(options.block_cache->InsertWithPriority(
+          key, index_block, index_block->size(), &DeleteCachedBlock,
+          Cache::Priority::kHigh));
+      rep->index_block = nullptr;
+    }
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -91,24 +170,64 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // The filter is optional, but range tombstones are needed for
+    // correct reads, so the error is propagated.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    // A table has either filter partitions, a full filter or per-block
+    // filters, whatever the current setting of the options.
+    const std::string name = rep_->options.filter_policy->Name();
+    std::string key = "partitionedfilter." + name;
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      // The filter partitions are found through the index
+      rep_->partitioned_filter = rep_->partitioned_index;
+    } else {
+      key = "fullfilter." + name;
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      } else {
+        key = "filter." + name;
+        iter->Seek(key);
+        if (iter->Valid() && iter->key() == Slice(key)) {
+          ReadFilter(iter->value(), false);
+        }
+      }
+    }
+    if ((rep_->filter != nullptr || rep_->partitioned_filter) &&
+        rep_->options.prefix_extractor != nullptr) {
+      key = "prefix.";
+      key.append(rep_->options.prefix_extractor->Name());
+      iter->Seek(key);
+      rep_->prefix_filtered = iter->Valid() && iter->key() == Slice(key);
+    }
+  }
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    Slice v = iter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&v);
+    BlockContents block;
+    if (s.ok()) {
+      s = ReadBlock(rep_->file, opt, handle, &block);
+    }
+    if (s.ok()) {
+      rep_->range_del_block = new Block(block);
+    }
   }
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
@@ -125,21 +244,38 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
   }
+  Cache* block_cache = rep_->options.block_cache;
+  if (rep_->options.cache_index_and_filter_blocks && block_cache != nullptr &&
+      block.cachable) {
+    // Hand the filter over to the block cache
+    CachedFilter* filter =
+        new CachedFilter(rep_->options.filter_policy, block, full);
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, filter_handle.offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    block_cache->Release(block_cache->InsertWithPriority(
+        key, filter, filter->size, &DeleteCachedFilter,
+        Cache::Priority::kHigh));
+    rep_->filter_cached = true;
+    rep_->filter_full = full;
+    rep_->filter_handle = filter_handle;
+    return;
+  }
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter =
+      new FilterBlockReader(rep_->options.filter_policy, block.data, full);
 }
 
 Table::~Table() { delete rep_; }
 
-static void DeleteBlock(void* arg, void* ignored) {
-  delete reinterpret_cast<Block*>(arg);
-}
-
-static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
 }
 
 static void ReleaseBlock(void* arg, void* h) {
@@ -148,12 +284,44 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+namespace {
+
+// The argument of the block functions of a table iterator.  The data
+// blocks it reads go through its own readahead buffer.
+struct TableIteratorState {
+  TableIteratorState(const Table* t, size_t readahead_size,
+                     uint64_t file_size)
+      : table(t), readahead(readahead_size, file_size) {}
+
+  const Table* const table;
+  ReadaheadBuffer readahead;
+};
+
+void DeleteTableIteratorState(void* arg, void* ignored) {
+  delete reinterpret_cast<TableIteratorState*>(arg);
+}
+
+}  // namespace
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
+  TableIteratorState* state = reinterpret_cast<TableIteratorState*>(arg);
+  return state->table->BlockIterator(options, index_value, false, false,
+                                     &state->readahead);
+}
+
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->BlockIterator(options, index_value, false, true, nullptr);
+}
+
+Iterator* Table::BlockIterator(const ReadOptions& options,
+                               const Slice& index_value, bool point_lookup,
+                               bool index, ReadaheadBuffer* readahead) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -167,24 +335,28 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(rep_->file, readahead, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+          // Index blocks are cached even for reads that skip the cache,
+          // as every read of the table needs them.
+          if (contents.cachable && (options.fill_cache || index)) {
+            cache_handle = block_cache->InsertWithPriority(
+                key, block, block->size(), &DeleteCachedBlock,
+                index ? MetaBlockPriority(rep_->options)
+                      : Cache::Priority::kLow);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, readahead, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -193,7 +365,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator, point_lookup);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -205,27 +377,146 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+bool Table::FilterMayMatch(const ReadOptions& options,
+                           const Slice& index_value, const Slice& key) const {
+  BlockHandle handle;
+  Slice input = index_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return true;
+  }
+  if (rep_->filter != nullptr) {
+    return rep_->filter->KeyMayMatch(handle.offset(), key);
+  }
+  if (rep_->filter_cached) {
+    return CachedFilterMayMatch(options, rep_->filter_handle, rep_->filter_full,
+                                handle.offset(), key);
+  }
+  if (!rep_->partitioned_filter) {
+    return true;
+  }
+
+  // The entries of a partitioned index also hold the handle of the
+  // filter partition of the block.
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&input).ok()) {
+    return true;
+  }
+  return CachedFilterMayMatch(options, filter_handle, true, 0, key);
+}
+
+bool Table::CachedFilterMayMatch(const ReadOptions& options,
+                                 const BlockHandle& filter_handle, bool full,
+                                 uint64_t block_offset,
+                                 const Slice& key) const {
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, filter_handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = nullptr;
+  CachedFilter* filter = nullptr;
+  if (block_cache != nullptr) {
+    cache_handle = block_cache->Lookup(cache_key);
+  }
+  if (cache_handle != nullptr) {
+    filter = reinterpret_cast<CachedFilter*>(block_cache->Value(cache_handle));
+  } else {
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, options, filter_handle, &contents).ok()) {
+      return true;  // Errors are treated as potential matches
+    }
+    filter = new CachedFilter(rep_->options.filter_policy, contents, full);
+    if (block_cache != nullptr && contents.cachable) {
+      cache_handle =
+          block_cache->InsertWithPriority(cache_key, filter, filter->size,
+                                          &DeleteCachedFilter,
+                                          MetaBlockPriority(rep_->options));
+    }
+  }
+
+  const bool may_match = filter->reader.KeyMayMatch(block_offset, key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete filter;
+  }
+  return may_match;
+}
+
+bool Table::BlockMayMatch(void* arg, const Slice& index_value,
+                          const Slice& target) {
+  TableIteratorState* state = reinterpret_cast<TableIteratorState*>(arg);
+  return state->table->BlockPrefixMayMatch(index_value, target);
+}
+
+bool Table::BlockPrefixMayMatch(const Slice& index_value,
+                                const Slice& target) const {
+  const SliceTransform* prefix_extractor = rep_->options.prefix_extractor;
+  if (!rep_->prefix_filtered || !prefix_extractor->InDomain(target)) {
+    return true;
+  }
+  return FilterMayMatch(ReadOptions(), index_value,
+                        prefix_extractor->Transform(target));
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter;
+  if (rep_->index_block != nullptr) {
+    iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  } else {
+    iter = BlockIterator(options, rep_->index_handle, false, true, nullptr);
+  }
+  if (rep_->partitioned_index) {
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  TableIteratorState* state =
+      new TableIteratorState(this, options.readahead_size, rep_->file_size);
+  Iterator* iter = NewTwoLevelIterator(
+      NewIndexIterator(options), &Table::BlockReader, &Table::BlockMayMatch,
+      rep_->options.comparator, state, options);
+  iter->RegisterCleanup(&DeleteTableIteratorState, state, nullptr);
+  return iter;
+}
+
+bool Table::PrefixMayMatch(const Slice& target) const {
+  if (!rep_->prefix_filtered ||
+      !rep_->options.prefix_extractor->InDomain(target)) {
+    return true;
+  }
+  // The keys sharing the prefix of "target" that are not before it start
+  // either in the block the index points at or at the beginning of the
+  // next block.
+  Iterator* iiter = NewIndexIterator(ReadOptions());
+  iiter->Seek(target);
+  bool may_match = false;
+  for (int i = 0; i < 2 && !may_match && iiter->Valid(); i++) {
+    may_match = BlockPrefixMayMatch(iiter->value(), target);
+    iiter->Next();
+  }
+  if (!iiter->status().ok()) {
+    may_match = true;  // Let the caller's iterator report the error
+  }
+  delete iiter;
+  return may_match;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
-    Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
-    BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (!FilterMayMatch(options, iiter->value(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter =
+          BlockIterator(options, iiter->value(), true, false, nullptr);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
@@ -241,9 +532,72 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+void Table::Prefetch(const ReadOptions& options,
+                     const std::vector<Slice>& keys,
+                     std::vector<bool>* may_match) const {
+  may_match->assign(keys.size(), true);
+  Cache* block_cache = rep_->options.block_cache;
+  const bool fetch = block_cache != nullptr && options.fill_cache;
+
+  std::vector<BlockHandle> handles;
+  std::set<uint64_t> offsets;
+  Iterator* iiter = NewIndexIterator(options);
+  for (size_t i = 0; i < keys.size(); i++) {
+    iiter->Seek(keys[i]);
+    if (!iiter->Valid()) {
+      (*may_match)[i] = !iiter->status().ok();
+      continue;
+    }
+    if (!FilterMayMatch(options, iiter->value(), keys[i])) {
+      (*may_match)[i] = false;
+      continue;
+    }
+    BlockHandle handle;
+    Slice input = iiter->value();
+    if (!fetch || !handle.DecodeFrom(&input).ok() ||
+        !offsets.insert(handle.offset()).second) {
+      continue;
+    }
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handle.offset());
+    Cache::Handle* cache_handle =
+        block_cache->Lookup(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (cache_handle != nullptr) {
+      block_cache->Release(cache_handle);
+    } else {
+      handles.push_back(handle);
+    }
+  }
+  delete iiter;
+  if (handles.empty()) {
+    return;
+  }
+
+  std::vector<BlockContents> contents(handles.size());
+  std::vector<Status> statuses(handles.size());
+  ReadBlocks(rep_->file, options, handles.data(), handles.size(),
+             contents.data(), statuses.data());
+  for (size_t i = 0; i < handles.size(); i++) {
+    if (!statuses[i].ok()) {
+      continue;  // The lookup reads the block again and reports the error
+    }
+    Block* block = new Block(contents[i]);
+    if (!contents[i].cachable) {
+      delete block;  // The file serves reads from memory anyway
+      continue;
+    }
+    char cache_key_buffer[16];
+    EncodeFixed64(cache_key_buffer, rep_->cache_id);
+    EncodeFixed64(cache_key_buffer + 8, handles[i].offset());
+    Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+    block_cache->Release(block_cache->InsertWithPriority(
+        key, block, block->size(), &DeleteCachedBlock, Cache::Priority::kLow));
+  }
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
@@ -5,11 +5,15 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -26,13 +30,23 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
+        num_range_tombstones(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
-                         ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        filter_block(opt.filter_policy == nullptr ? nullptr
+                                                  : NewFilterBlockBuilder(opt)),
+        pending_index_entry(false),
+        partition_size(0) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
+  }
+
+  // Partitioned indexes use one full filter per index partition.
+  static FilterBlockBuilder* NewFilterBlockBuilder(const Options& opt) {
+    return new FilterBlockBuilder(
+        opt.filter_policy, opt.prefix_extractor,
+        opt.full_filter || opt.partition_index_and_filters);
   }
 
   Options options;
@@ -42,8 +56,10 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_tombstones;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
@@ -59,6 +75,18 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // With options.partition_index_and_filters, the index entries and the
+  // filter of every index partition, the last of which is still being
+  // filled.  They are written by Finish() after the data blocks, once
+  // the location of the filter partitions, which the index entries point
+  // at along with their data blocks, is known.
+  struct IndexPartition {
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string filter;
+  };
+  std::vector<IndexPartition> index_partitions;
+  size_t partition_size;  // Size of the entries of the last partition
+
   std::string compressed_output;
 };
 
@@ -82,12 +110,26 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing prefix extractor while building table");
+  }
+  if (options.full_filter != rep_->options.full_filter) {
+    return Status::InvalidArgument(
+        "changing filter format while building table");
+  }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing index format while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -102,9 +144,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    AddIndexEntry(r->last_key, r->pending_handle);
     r->pending_index_entry = false;
   }
 
@@ -138,6 +178,66 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::AddIndexEntry(const Slice& key, const BlockHandle& handle) {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  handle.EncodeTo(&handle_encoding);
+  if (!r->options.partition_index_and_filters) {
+    r->index_block.Add(key, handle_encoding);
+    return;
+  }
+
+  if (r->index_partitions.empty()) {
+    r->index_partitions.emplace_back();
+  }
+  r->index_partitions.back().entries.emplace_back(key.ToString(),
+                                                  handle_encoding);
+  // Count the entry header and the filter handle as well
+  r->partition_size += key.size() + handle_encoding.size() + 8;
+  if (r->partition_size >= r->options.metadata_block_size) {
+    // The filter builder holds the keys of the blocks of the partition
+    if (r->filter_block != nullptr) {
+      r->index_partitions.back().filter = r->filter_block->Finish().ToString();
+      delete r->filter_block;
+      r->filter_block = Rep::NewFilterBlockBuilder(r->options);
+    }
+    r->index_partitions.emplace_back();
+    r->partition_size = 0;
+  }
+}
+
+void TableBuilder::WriteIndexPartitions() {
+  Rep* r = rep_;
+  if (!r->index_partitions.empty() &&
+      r->index_partitions.back().entries.empty()) {
+    r->index_partitions.pop_back();
+  } else if (!r->index_partitions.empty() && r->filter_block != nullptr) {
+    r->index_partitions.back().filter = r->filter_block->Finish().ToString();
+  }
+
+  BlockBuilder partition_block(&r->index_block_options);
+  for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+    Rep::IndexPartition& partition = r->index_partitions[i];
+    std::string filter_handle_encoding;
+    if (r->filter_block != nullptr) {
+      BlockHandle filter_handle;
+      WriteRawBlock(partition.filter, kNoCompression, &filter_handle);
+      filter_handle.EncodeTo(&filter_handle_encoding);
+    }
+    for (auto& entry : partition.entries) {
+      entry.second.append(filter_handle_encoding);
+      partition_block.Add(entry.first, entry.second);
+    }
+    if (!ok()) break;
+    BlockHandle partition_handle;
+    WriteBlock(&partition_block, &partition_handle);
+    std::string handle_encoding;
+    partition_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(partition.entries.back().first, handle_encoding);
+  }
+  r->index_partitions.clear();
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -208,6 +308,14 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+  r->num_range_tombstones++;
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 Status TableBuilder::Finish() {
@@ -216,24 +324,64 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, range_del_block_handle,
+      metaindex_block_handle, index_block_handle;
 
-  // Write filter block
-  if (ok() && r->filter_block != nullptr) {
+  // Write filter block, or the index and filter partitions
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry(r->last_key, r->pending_handle);
+    r->pending_index_entry = false;
+  }
+  if (ok() && r->options.partition_index_and_filters) {
+    WriteIndexPartitions();
+  } else if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
+  // Write range tombstone block
+  if (ok() && r->num_range_tombstones > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // Readers look the metaindex block up with the bytewise comparator,
+    // whatever comparator the table uses for its keys.
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    meta_index_options.data_block_hash_index = false;
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
-      key.append(r->options.filter_policy->Name());
+      // Add mapping from "filter.Name" (or "fullfilter.Name" for a full
+      // filter) to location of filter data.  Partitioned filters are
+      // located through the index, and "partitionedfilter.Name" only
+      // records that the index entries point at them.
+      std::string key;
       std::string handle_encoding;
-      filter_block_handle.EncodeTo(&handle_encoding);
+      if (r->options.partition_index_and_filters) {
+        key = "partitionedfilter.";
+      } else {
+        key = r->options.full_filter ? "fullfilter." : "filter.";
+        filter_block_handle.EncodeTo(&handle_encoding);
+      }
+      key.append(r->options.filter_policy->Name());
       meta_index_block.Add(key, handle_encoding);
+      if (r->options.prefix_extractor != nullptr) {
+        // Record that the filters also contain the prefixes of the keys
+        // as "prefix.Name", so readers only probe them for prefixes when
+        // they use the same extractor.
+        key = "prefix.";
+        key.append(r->options.prefix_extractor->Name());
+        meta_index_block.Add(key, Slice());
+      }
+    }
+    if (r->num_range_tombstones > 0) {
+      // "rangedel" sorts after the filter and prefix entries above
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
     }
 
     // TODO(postrelease): Add stats and other meta blocks
@@ -242,13 +390,6 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -257,6 +398,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(r->options.partition_index_and_filters);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -275,6 +417,10 @@ void TableBuilder::Abandon() {
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
 uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
@@ -19,6 +19,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -326,6 +327,49 @@ class MemTableConstructor : public Constructor {
   MemTable* memtable_;
 };
 
+// Spreads the data over several blocks and merges them back together.
+class MergingConstructor : public Constructor {
+ public:
+  explicit MergingConstructor(const Comparator* cmp)
+      : Constructor(cmp), comparator_(cmp) {
+    for (int i = 0; i < kNumChildren; i++) {
+      children_[i] = new BlockConstructor(cmp);
+    }
+  }
+  ~MergingConstructor() override {
+    for (int i = 0; i < kNumChildren; i++) {
+      delete children_[i];
+    }
+  }
+  Status FinishImpl(const Options& options, const KVMap& data) override {
+    std::vector<KVMap> parts(kNumChildren, KVMap(STLLessThan(comparator_)));
+    int n = 0;
+    for (const auto& kvp : data) {
+      parts[n++ % kNumChildren][kvp.first] = kvp.second;
+    }
+    for (int i = 0; i < kNumChildren; i++) {
+      Status s = children_[i]->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  Iterator* NewIterator() const override {
+    Iterator* list[kNumChildren];
+    for (int i = 0; i < kNumChildren; i++) {
+      list[i] = children_[i]->NewIterator();
+    }
+    return NewMergingIterator(comparator_, list, kNumChildren);
+  }
+
+ private:
+  enum { kNumChildren = 7 };
+
+  const Comparator* const comparator_;
+  BlockConstructor* children_[kNumChildren];
+};
+
 class DBConstructor : public Constructor {
  public:
   explicit DBConstructor(const Comparator* cmp)
@@ -371,7 +415,14 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  MERGER_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -387,6 +438,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Tables whose index is partitioned
+    {PARTITIONED_TABLE_TEST, false, 16},
+    {PARTITIONED_TABLE_TEST, true, 16},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -398,6 +453,10 @@ static const TestArgs kTestArgList[] = {
     {MEMTABLE_TEST, false, 16},
     {MEMTABLE_TEST, true, 16},
 
+    // Restart interval does not matter for merging iterators either
+    {MERGER_TEST, false, 16},
+    {MERGER_TEST, true, 16},
+
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
     {DB_TEST, true, 16},
@@ -424,12 +483,21 @@ class Harness : public testing::Test {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        // Use small partitions to exercise their boundaries
+        options_.partition_index_and_filters = true;
+        options_.metadata_block_size = 64;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergingConstructor(options_.comparator);
+        break;
       case DB_TEST:
         constructor_ = new DBConstructor(options_.comparator);
         break;
@@ -639,6 +707,68 @@ TEST_F(Harness, ZeroRestartPointsInBlock) {
   delete iter;
 }
 
+TEST(BlockTest, HashIndex) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+
+  // Three versions of every even key, so that the entries of some user
+  // keys span two restart intervals.
+  BlockBuilder builder(&options);
+  char buf[16];
+  for (int i = 0; i < 200; i += 2) {
+    std::snprintf(buf, sizeof(buf), "key%03d", i);
+    for (SequenceNumber seq = 30; seq >= 10; seq -= 10) {
+      builder.Add(InternalKey(buf, seq, kTypeValue).Encode(),
+                  std::to_string(seq));
+    }
+  }
+  std::string data = builder.Finish().ToString();
+  ASSERT_NE(0, DecodeFixed32(data.data() + data.size() - 4) &
+                   Block::kHashIndexFlag);
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  for (int i = 0; i < 200; i++) {
+    std::snprintf(buf, sizeof(buf), "key%03d", i);
+    for (SequenceNumber seq :
+         {kMaxSequenceNumber, SequenceNumber{25}, SequenceNumber{10}}) {
+      Iterator* iter = block.NewIterator(&icmp, true);
+      iter->Seek(InternalKey(buf, seq, kValueTypeForSeek).Encode());
+      if (i % 2 == 0) {
+        ASSERT_TRUE(iter->Valid()) << buf;
+        ASSERT_EQ(buf, ExtractUserKey(iter->key()).ToString());
+        ASSERT_EQ(seq == 25 ? "20" : seq == 10 ? "10" : "30",
+                  iter->value().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid() ||
+                    ExtractUserKey(iter->key()) != Slice(buf))
+            << buf;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      delete iter;
+    }
+  }
+
+  // Iterators that are not for point lookups ignore the hash index
+  Iterator* iter = block.NewIterator(&icmp);
+  iter->Seek(InternalKey("key001", kMaxSequenceNumber, kValueTypeForSeek)
+                 .Encode());
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("key002", ExtractUserKey(iter->key()).ToString());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(300, count);
+  delete iter;
+}
+
 // Test the empty key
 TEST_F(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
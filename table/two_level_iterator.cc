@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/comparator.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -14,11 +15,14 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef bool (*MayMatchFunction)(void*, const Slice&, const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   MayMatchFunction may_match_function,
+                   const Comparator* comparator, void* arg,
+                   const ReadOptions& options);
 
   ~TwoLevelIterator() override;
 
@@ -56,8 +60,26 @@ class TwoLevelIterator : public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void SeekWithPrefix(const Slice& target);
+
+  // The blocks after the one whose index key is "index_key" only hold
+  // keys at or after the upper bound.
+  bool AfterUpperBound(const Slice& index_key) const {
+    return upper_bound_ != nullptr &&
+           comparator_->Compare(index_key, *upper_bound_) >= 0;
+  }
+  // The block whose index key is "index_key" only holds keys before the
+  // lower bound.
+  bool BeforeLowerBound(const Slice& index_key) const {
+    return lower_bound_ != nullptr &&
+           comparator_->Compare(index_key, *lower_bound_) < 0;
+  }
 
   BlockFunction block_function_;
+  MayMatchFunction may_match_function_;  // nullptr unless prefix seeks
+  const Comparator* const comparator_;
+  const Slice* const lower_bound_;  // nullptr unless bounded
+  const Slice* const upper_bound_;  // nullptr unless bounded
   void* arg_;
   const ReadOptions options_;
   Status status_;
@@ -69,9 +91,18 @@ class TwoLevelIterator : public Iterator {
 };
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
-                                   BlockFunction block_function, void* arg,
+                                   BlockFunction block_function,
+                                   MayMatchFunction may_match_function,
+                                   const Comparator* comparator, void* arg,
                                    const ReadOptions& options)
     : block_function_(block_function),
+      may_match_function_(options.prefix_same_as_start ? may_match_function
+                                                       : nullptr),
+      comparator_(comparator),
+      lower_bound_(comparator != nullptr ? options.iterate_lower_bound
+                                         : nullptr),
+      upper_bound_(comparator != nullptr ? options.iterate_upper_bound
+                                         : nullptr),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
@@ -80,23 +111,71 @@ TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
 TwoLevelIterator::~TwoLevelIterator() = default;
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  if (upper_bound_ != nullptr &&
+      comparator_->Compare(target, *upper_bound_) >= 0) {
+    SetDataIterator(nullptr);
+    return;
+  }
   index_iter_.Seek(target);
+  if (may_match_function_ != nullptr) {
+    SeekWithPrefix(target);
+    return;
+  }
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
   SkipEmptyDataBlocksForward();
 }
 
+void TwoLevelIterator::SeekWithPrefix(const Slice& target) {
+  // The entries sharing the prefix of "target" that are not before it
+  // start either in the block the index points at or at the beginning
+  // of the next block, so there is no need to look any further.
+  for (int i = 0; i < 2 && index_iter_.Valid(); i++) {
+    if ((*may_match_function_)(arg_, index_iter_.value(), target)) {
+      InitDataBlock();
+      if (data_iter_.iter() != nullptr) {
+        data_iter_.Seek(target);
+        if (data_iter_.Valid()) return;
+      }
+    }
+    index_iter_.Next();
+  }
+  SetDataIterator(nullptr);
+}
+
 void TwoLevelIterator::SeekToFirst() {
-  index_iter_.SeekToFirst();
-  InitDataBlock();
-  if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
+  if (lower_bound_ != nullptr) {
+    // Start at the first entry at or after the bound
+    index_iter_.Seek(*lower_bound_);
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) data_iter_.Seek(*lower_bound_);
+  } else {
+    index_iter_.SeekToFirst();
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
+  }
   SkipEmptyDataBlocksForward();
 }
 
 void TwoLevelIterator::SeekToLast() {
-  index_iter_.SeekToLast();
-  InitDataBlock();
-  if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+  if (upper_bound_ != nullptr) {
+    // Start at the last entry before the bound
+    index_iter_.Seek(*upper_bound_);
+    if (!index_iter_.Valid()) index_iter_.SeekToLast();
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) {
+      data_iter_.Seek(*upper_bound_);
+      if (data_iter_.Valid()) {
+        data_iter_.Prev();
+      } else {
+        data_iter_.SeekToLast();
+      }
+    }
+  } else {
+    index_iter_.SeekToLast();
+    InitDataBlock();
+    if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+  }
   SkipEmptyDataBlocksBackward();
 }
 
@@ -115,7 +194,7 @@ void TwoLevelIterator::Prev() {
 void TwoLevelIterator::SkipEmptyDataBlocksForward() {
   while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
     // Move to next block
-    if (!index_iter_.Valid()) {
+    if (!index_iter_.Valid() || AfterUpperBound(index_iter_.key())) {
       SetDataIterator(nullptr);
       return;
     }
@@ -133,6 +212,10 @@ void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
       return;
     }
     index_iter_.Prev();
+    if (index_iter_.Valid() && BeforeLowerBound(index_iter_.key())) {
+      SetDataIterator(nullptr);
+      return;
+    }
     InitDataBlock();
     if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
   }
@@ -165,7 +248,17 @@ void TwoLevelIterator::InitDataBlock() {
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
                               const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+  return new TwoLevelIterator(index_iter, block_function, nullptr, nullptr,
+                              arg, options);
+}
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter,
+                              BlockFunction block_function,
+                              MayMatchFunction may_match_function,
+                              const Comparator* comparator, void* arg,
+                              const ReadOptions& options) {
+  return new TwoLevelIterator(index_iter, block_function, may_match_function,
+                              comparator, arg, options);
 }
 
 }  // namespace leveldb
@@ -9,6 +9,7 @@
 
 namespace leveldb {
 
+class Comparator;
 struct ReadOptions;
 
 // Return a new two level iterator.  A two-level iterator contains an
@@ -26,6 +27,27 @@ Iterator* NewTwoLevelIterator(
                                 const Slice& index_value),
     void* arg, const ReadOptions& options);
 
+// Like the above, but if options.prefix_same_as_start is true, Seek()
+// calls (*may_match_function)(arg, index_value, target) before reading
+// the blocks that could hold the first entry at or after "target", and
+// skips the blocks for which it returns false.  Since the keys sharing a
+// prefix are adjacent, the iterator becomes invalid if neither of the
+// first two candidate blocks may hold keys with the prefix of "target".
+// Entries that follow do not share that prefix in that case, so callers
+// must not rely on the position of such an iterator otherwise.
+//
+// The bounds in options.iterate_lower_bound and options.iterate_upper_bound
+// are compared with the index keys using "comparator".  Blocks that lie
+// entirely outside of them are not read; the entries of the blocks that
+// are read may still fall outside of them.
+Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* (*block_function)(void* arg, const ReadOptions& options,
+                                const Slice& index_value),
+    bool (*may_match_function)(void* arg, const Slice& index_value,
+                               const Slice& target),
+    const Comparator* comparator, void* arg, const ReadOptions& options);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
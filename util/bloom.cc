@@ -4,7 +4,11 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/slice.h"
+#include "util/coding.h"
 #include "util/hash.h"
 
 namespace leveldb {
@@ -14,6 +18,203 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// Ribbon filters share their name with bloom filters and are told apart by
+// their last byte, which for a bloom filter holds a probe count of at most
+// 30.  Readers that predate ribbon filters treat larger values as matching
+// everything, so the two formats can be mixed within a database.
+//
+// Format: [solution] [num_blocks: fixed32] [seed: 1 byte]
+//         [result bits: 1 byte] [kRibbonMarker: 1 byte]
+//
+// A ribbon filter stores a solution to a system of linear equations over
+// GF(2), one per key: each key picks a run of 64 consecutive slots and a
+// random subset of them, and the XOR of the r-bit solution values in that
+// subset must equal r bits derived from the key.  A key that was not added
+// satisfies its equation with probability 2^-r, which takes 70-80% of the
+// space a bloom filter needs for the same false positive rate.  The
+// solution is kept in blocks of 64 slots, each block being r 64-bit words
+// that hold one bit of every slot, so a lookup reads two adjacent blocks.
+static const uint8_t kRibbonMarker = 0xff;
+static const size_t kRibbonTrailer = 7;
+static const int kRibbonMaxSeeds = 8;
+
+static uint64_t RibbonMix(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return h;
+}
+
+static uint32_t RibbonParity(uint64_t x) {
+#if defined(__GNUC__)
+  return static_cast<uint32_t>(__builtin_parityll(x));
+#else
+  x ^= x >> 32;
+  x ^= x >> 16;
+  x ^= x >> 8;
+  x ^= x >> 4;
+  x ^= x >> 2;
+  x ^= x >> 1;
+  return static_cast<uint32_t>(x & 1);
+#endif
+}
+
+static int RibbonTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static uint64_t RibbonHash(const Slice& key) {
+  return (static_cast<uint64_t>(Hash(key.data(), key.size(), 0x7a2bb9d5))
+          << 32) |
+         BloomHash(key);
+}
+
+// The equation of one key: its first slot, the subset of the 64 slots
+// starting there (bit 0 is always set) and the bits the subset must XOR to.
+struct RibbonRow {
+  RibbonRow(uint64_t hash, int seed, size_t slots, int result_bits) {
+    const uint64_t h =
+        RibbonMix(hash + static_cast<uint64_t>(seed) * 0x9e3779b97f4a7c15ull);
+    start = static_cast<size_t>(((h >> 32) * (slots - 63)) >> 32);
+    coeff = RibbonMix(h) | 1;
+    result = static_cast<uint32_t>(h) & ((uint64_t{1} << result_bits) - 1);
+  }
+
+  size_t start;
+  uint64_t coeff;
+  uint32_t result;
+};
+
+// Returns the number of blocks of 64 slots to use for n keys.  Finding a
+// solution needs some spare slots, and more of them as n grows.
+static size_t RibbonBlocks(size_t n) {
+  double overhead;
+  if (n < 10000) {
+    overhead = 0.05;
+  } else if (n < 100000) {
+    overhead = 0.08;
+  } else if (n < 1000000) {
+    overhead = 0.12;
+  } else {
+    overhead = 0.16;
+  }
+  const size_t slots = n + static_cast<size_t>(n * overhead) + 63;
+  return (slots + 63) / 64;
+}
+
+// Tries to build a ribbon filter for the keys with the given hashes and
+// appends it to *dst.  Returns false, leaving *dst unchanged, if no
+// solution was found.
+static bool CreateRibbonFilter(const std::vector<uint64_t>& hashes,
+                               int result_bits, std::string* dst) {
+  const size_t blocks = RibbonBlocks(hashes.size());
+  const size_t slots = blocks * 64;
+  std::vector<uint64_t> coeffs(slots);
+  std::vector<uint32_t> results(slots);
+
+  int seed = 0;
+  for (; seed < kRibbonMaxSeeds; seed++) {
+    // Gaussian elimination on the fly: every slot holds at most one
+    // equation, whose subset starts at that slot.
+    std::fill(coeffs.begin(), coeffs.end(), 0);
+    bool ok = true;
+    for (size_t i = 0; i < hashes.size() && ok; i++) {
+      RibbonRow row(hashes[i], seed, slots, result_bits);
+      size_t s = row.start;
+      uint64_t c = row.coeff;
+      uint32_t r = row.result;
+      while (true) {
+        if (coeffs[s] == 0) {
+          coeffs[s] = c;
+          results[s] = r;
+          break;
+        }
+        c ^= coeffs[s];
+        r ^= results[s];
+        if (c == 0) {
+          // The equation is implied by earlier ones (e.g. a duplicate
+          // key) if the results agree, and contradicts them otherwise.
+          ok = (r == 0);
+          break;
+        }
+        const int shift = RibbonTrailingZeros(c);
+        s += shift;
+        c >>= shift;
+      }
+    }
+    if (ok) break;
+  }
+  if (seed == kRibbonMaxSeeds) return false;
+
+  // Back substitution, from the last slot down.  Slots without an
+  // equation are free and set to zero.
+  std::vector<uint32_t> solution(slots + 64, 0);
+  for (size_t i = slots; i-- > 0;) {
+    uint32_t v = (coeffs[i] != 0) ? results[i] : 0;
+    for (uint64_t c = coeffs[i] >> 1; c != 0; c &= c - 1) {
+      v ^= solution[i + 1 + RibbonTrailingZeros(c)];
+    }
+    solution[i] = v;
+  }
+
+  const size_t init_size = dst->size();
+  dst->resize(init_size + blocks * result_bits * 8);
+  char* array = &(*dst)[init_size];
+  for (size_t b = 0; b < blocks; b++) {
+    for (int j = 0; j < result_bits; j++) {
+      uint64_t word = 0;
+      for (int o = 0; o < 64; o++) {
+        word |= static_cast<uint64_t>((solution[b * 64 + o] >> j) & 1) << o;
+      }
+      EncodeFixed64(array + (b * result_bits + j) * 8, word);
+    }
+  }
+  PutFixed32(dst, static_cast<uint32_t>(blocks));
+  dst->push_back(static_cast<char>(seed));
+  dst->push_back(static_cast<char>(result_bits));
+  dst->push_back(static_cast<char>(kRibbonMarker));
+  return true;
+}
+
+static bool RibbonKeyMayMatch(const Slice& key, const Slice& filter) {
+  const size_t len = filter.size();
+  if (len < kRibbonTrailer) return true;
+  const char* trailer = filter.data() + len - kRibbonTrailer;
+  const size_t blocks = DecodeFixed32(trailer);
+  const int seed = static_cast<uint8_t>(trailer[4]);
+  const int result_bits = static_cast<uint8_t>(trailer[5]);
+  if (blocks == 0 || result_bits < 1 || result_bits > 30 ||
+      blocks * result_bits * 8 != len - kRibbonTrailer) {
+    // Not a filter we know how to decode.  Consider it a match.
+    return true;
+  }
+
+  RibbonRow row(RibbonHash(key), seed, blocks * 64, result_bits);
+  const size_t b = row.start / 64;
+  const int o = row.start % 64;
+  const char* lo = filter.data() + b * result_bits * 8;
+  const char* hi = lo + result_bits * 8;
+  for (int j = 0; j < result_bits; j++) {
+    uint64_t window = DecodeFixed64(lo + j * 8) >> o;
+    if (o != 0) window |= DecodeFixed64(hi + j * 8) << (64 - o);
+    if (RibbonParity(window & row.coeff) != ((row.result >> j) & 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
   explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
@@ -62,6 +263,9 @@ class BloomFilterPolicy : public FilterPolicy {
 
     // Use the encoded k so that we can read filters generated by
     // bloom filters created using different parameters.
+    if (static_cast<uint8_t>(array[len - 1]) == kRibbonMarker) {
+      return RibbonKeyMayMatch(key, bloom_filter);
+    }
     const size_t k = array[len - 1];
     if (k > 30) {
       // Reserved for potentially new encodings for short bloom filters.
@@ -83,10 +287,137 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// Builds ribbon filters where they come out smaller than the bloom filter
+// for the same keys, which is the case unless there are only a handful of
+// keys, and bloom filters otherwise.  Filters of either kind are read by
+// both this policy and BloomFilterPolicy.
+class RibbonFilterPolicy : public BloomFilterPolicy {
+ public:
+  explicit RibbonFilterPolicy(int bloom_equivalent_bits_per_key)
+      : BloomFilterPolicy(bloom_equivalent_bits_per_key),
+        bloom_bits_per_key_(bloom_equivalent_bits_per_key) {
+    // A bloom filter with b bits per key has a false positive rate of
+    // about 0.6185^b =~ 2^(-0.69 * b).
+    result_bits_ =
+        static_cast<int>(bloom_equivalent_bits_per_key * 0.69 + 0.5);
+    if (result_bits_ < 1) result_bits_ = 1;
+    if (result_bits_ > 30) result_bits_ = 30;
+  }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // Size of the bloom filter for the same keys, see above.
+    const size_t bloom_bits = std::max<size_t>(n * bloom_bits_per_key_, 64);
+    const size_t bloom_bytes = (bloom_bits + 7) / 8 + 1;
+    const size_t ribbon_bytes =
+        RibbonBlocks(n) * result_bits_ * 8 + kRibbonTrailer;
+    if (ribbon_bytes < bloom_bytes) {
+      std::vector<uint64_t> hashes(n);
+      for (int i = 0; i < n; i++) {
+        hashes[i] = RibbonHash(keys[i]);
+      }
+      if (CreateRibbonFilter(hashes, result_bits_, dst)) return;
+    }
+    BloomFilterPolicy::CreateFilter(keys, n, dst);
+  }
+
+ private:
+  size_t bloom_bits_per_key_;
+  int result_bits_;
+};
+
+// A bloom filter split into 64-byte lines.  Every key sets and probes k
+// bits within a single line picked by its hash, so a lookup touches one
+// cache line instead of k scattered ones, and the probes within the line
+// are independent of each other.  Positions are derived from the hash
+// by multiplication and shifts rather than by division.
+//
+// Format: [line 0] ... [line n-1] [k: 1 byte], each line being 64 bytes.
+class CacheLocalBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit CacheLocalBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  const char* Name() const override { return "leveldb.CacheLocalBloomFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    const size_t bits = n * bits_per_key_;
+    size_t lines = (bits + kLineBits - 1) / kLineBits;
+    if (lines < 1) lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, lines) * kLineBytes;
+      uint32_t probe = h * kMultiplier;
+      for (size_t j = 0; j < k_; j++) {
+        const uint32_t bitpos = probe >> (32 - kLineBitsLg);
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+        probe *= kMultiplier;
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < 2) return false;
+    if ((len - 1) % kLineBytes != 0) {
+      // Not a filter of this format.  Consider it a match.
+      return true;
+    }
+
+    const char* array = bloom_filter.data();
+    const size_t lines = (len - 1) / kLineBytes;
+    const size_t k = array[len - 1];
+    if (k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const char* line = array + LineIndex(h, lines) * kLineBytes;
+    uint32_t probe = h * kMultiplier;
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = probe >> (32 - kLineBitsLg);
+      if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+      probe *= kMultiplier;
+    }
+    return true;
+  }
+
+ private:
+  static const size_t kLineBytes = 64;
+  static const size_t kLineBitsLg = 9;
+  static const size_t kLineBits = kLineBytes * 8;
+  static const uint32_t kMultiplier = 0x9e3779b9;  // Golden ratio
+
+  // Maps "h" uniformly onto [0, lines) without a division.
+  static size_t LineIndex(uint32_t h, size_t lines) {
+    return static_cast<size_t>((static_cast<uint64_t>(h) * lines) >> 32);
+  }
+
+  size_t bits_per_key_;
+  size_t k_;
+};
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewRibbonFilterPolicy(int bloom_equivalent_bits_per_key) {
+  return new RibbonFilterPolicy(bloom_equivalent_bits_per_key);
+}
+
+const FilterPolicy* NewCacheLocalBloomFilterPolicy(int bits_per_key) {
+  return new CacheLocalBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
@@ -19,7 +19,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -55,6 +56,8 @@ class BloomTest : public testing::Test {
     std::fprintf(stderr, ")\n");
   }
 
+  const std::string& filter() const { return filter_; }
+
   bool Matches(const Slice& s) {
     if (!keys_.empty()) {
       Build();
@@ -149,6 +152,159 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+class RibbonTest : public BloomTest {
+ public:
+  RibbonTest() : BloomTest(NewRibbonFilterPolicy(10)) {}
+};
+
+TEST_F(RibbonTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(RibbonTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(RibbonTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Never larger than the bloom filter, and clearly smaller once there
+    // are enough keys for a ribbon filter to pay off.
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+        << length;
+    if (length >= 5000) {
+      ASSERT_LE(FilterSize(), static_cast<size_t>(length * 10 / 8 * 0.8))
+          << length;
+    }
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);  // Must not be over 2%
+  }
+}
+
+TEST_F(RibbonTest, DuplicateKeys) {
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 2000; i++) {
+    Add(Key(i % 500, buffer));
+  }
+  for (int i = 0; i < 500; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer))) << i;
+  }
+  ASSERT_LE(FalsePositiveRate(), 0.02);
+}
+
+TEST_F(RibbonTest, ReadByBloomPolicy) {
+  const FilterPolicy* bloom = NewBloomFilterPolicy(10);
+  char buffer[sizeof(int)];
+  for (int length : {3, 5000}) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+    int false_positives = 0;
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(bloom->KeyMayMatch(Key(i, buffer), filter()));
+      if (bloom->KeyMayMatch(Key(i + 1000000000, buffer), filter())) {
+        false_positives++;
+      }
+    }
+    ASSERT_LE(false_positives, length / 50 + 1) << length;
+  }
+  delete bloom;
+}
+
+TEST_F(BloomTest, ReadByRibbonPolicy) {
+  const FilterPolicy* ribbon = NewRibbonFilterPolicy(10);
+  ASSERT_EQ(std::string(ribbon->Name()), "leveldb.BuiltinBloomFilter2");
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 5000; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  for (int i = 0; i < 5000; i++) {
+    ASSERT_TRUE(ribbon->KeyMayMatch(Key(i, buffer), filter()));
+  }
+  delete ribbon;
+}
+
+class CacheLocalBloomTest : public BloomTest {
+ public:
+  CacheLocalBloomTest() : BloomTest(NewCacheLocalBloomFilterPolicy(10)) {}
+};
+
+TEST_F(CacheLocalBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(CacheLocalBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(CacheLocalBloomTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Whole 64-byte lines plus the probe count
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 65))
+        << length;
+    ASSERT_EQ(1, FilterSize() % 64) << length;
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // Check false positive rate.  Packing the bits of each key into one
+    // line costs a little accuracy.
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      std::fprintf(stderr,
+                   "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                   rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.03);  // Must not be over 3%
+  }
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
@@ -17,6 +17,14 @@ namespace leveldb {
 
 Cache::~Cache() {}
 
+Cache::Handle* Cache::InsertWithPriority(const Slice& key, void* value,
+                                         size_t charge,
+                                         void (*deleter)(const Slice& key,
+                                                         void* value),
+                                         Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
 namespace {
 
 // LRU cache implementation
@@ -34,6 +42,15 @@ namespace {
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
 // - LRU:  contains the items not currently referenced by clients, in LRU order
+//
+// Items that are not referenced by clients and were inserted with high
+// priority sit on a third, high-priority LRU list instead.  Eviction drains
+// the low-priority list before touching the high-priority one.  The charge of
+// high-priority items is bounded by the high-priority pool capacity; beyond
+// that the oldest unreferenced ones are demoted to the low-priority list.
+// A segmented LRU cache uses the high-priority list as its protected segment
+// and the low-priority list as its probationary segment: entries found by
+// Lookup() are promoted to the protected segment.
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
@@ -49,6 +66,7 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool high_pri;     // Whether entry is charged to the high-priority pool.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -154,12 +172,18 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, size_t high_pri_capacity,
+                   bool promote_on_hit) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+    promote_on_hit_ = promote_on_hit;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
@@ -175,19 +199,27 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void MaintainHighPriPool() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
+  bool promote_on_hit_;  // Whether Lookup() moves entries to the pool
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of high-priority LRU list.  Same ordering and invariants as
+  // lru_, for entries with high_pri==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -195,23 +227,32 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      promote_on_hit_(false),
+      usage_(0),
+      high_pri_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of lru_ lists.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
@@ -231,8 +272,26 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to the lru_ list matching its priority.
+    LRU_Remove(e);
+    if (e->high_pri) {
+      LRU_Append(&high_pri_lru_, e);
+      MaintainHighPriPool();
+    } else {
+      LRU_Append(&lru_, e);
+    }
+  }
+}
+
+// Demote the oldest unreferenced high-priority entries until the pool fits
+// its capacity again.
+void LRUCache::MaintainHighPriPool() {
+  while (high_pri_usage_ > high_pri_capacity_ &&
+         high_pri_lru_.next != &high_pri_lru_) {
+    LRUHandle* e = high_pri_lru_.next;
     LRU_Remove(e);
+    e->high_pri = false;
+    high_pri_usage_ -= e->charge;
     LRU_Append(&lru_, e);
   }
 }
@@ -254,6 +313,12 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    if (promote_on_hit_ && !e->high_pri && e->in_cache &&
+        high_pri_capacity_ > 0) {
+      // Joins the pool once released; see Unref()
+      e->high_pri = true;
+      high_pri_usage_ += e->charge;
+    }
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
@@ -267,7 +332,8 @@ void LRUCache::Release(Cache::Handle* handle) {
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                                void* value)) {
+                                                void* value),
+                                Cache::Priority priority) {
   MutexLock l(&mutex_);
 
   LRUHandle* e =
@@ -278,6 +344,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = false;
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -286,13 +353,19 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (priority == Cache::Priority::kHigh && high_pri_capacity_ > 0) {
+      e->high_pri = true;
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  MaintainHighPriPool();
+  while (usage_ > capacity_ &&
+         (lru_.next != &lru_ || high_pri_lru_.next != &high_pri_lru_)) {
+    LRUHandle* old = lru_.next != &lru_ ? lru_.next : high_pri_lru_.next;
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -311,6 +384,9 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->high_pri) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
@@ -323,12 +399,14 @@ void LRUCache::Erase(const Slice& key, uint32_t hash) {
 
 void LRUCache::Prune() {
   MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    while (list->next != list) {
+      LRUHandle* e = list->next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
 }
@@ -349,17 +427,28 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  bool promote_on_hit)
+      : last_id_(0) {
+    assert(high_pri_pool_ratio >= 0 && high_pri_pool_ratio <= 1);
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    const size_t high_pri_per_shard =
+        static_cast<size_t>(per_shard * high_pri_pool_ratio);
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_per_shard, promote_on_hit);
     }
   }
   ~ShardedLRUCache() override {}
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return InsertWithPriority(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -396,6 +485,16 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return new ShardedLRUCache(capacity, 0.0, false);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, false);
+}
+
+Cache* NewSegmentedLRUCache(size_t capacity) {
+  return new ShardedLRUCache(capacity, 0.8, true);
+}
 
 }  // namespace leveldb
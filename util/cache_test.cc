@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -54,6 +56,12 @@ class CacheTest : public testing::Test {
                                    &CacheTest::Deleter));
   }
 
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->InsertWithPriority(
+        EncodeKey(key), EncodeValue(value), charge, &CacheTest::Deleter,
+        Cache::Priority::kHigh));
+  }
+
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
                           &CacheTest::Deleter);
@@ -213,6 +221,90 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+TEST_F(CacheTest, HighPriorityPool) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5);
+
+  // High-priority entries survive a stream of low-priority inserts.
+  for (int i = 0; i < 100; i++) {
+    InsertHighPriority(i, 1000 + i);
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+
+  // Beyond the pool capacity, the oldest high-priority entries are demoted
+  // and evicted like any other.
+  for (int i = 0; i < kCacheSize; i++) {
+    InsertHighPriority(100 + i, 1100 + i);
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  int survivors = 0;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    if (Lookup(i) >= 0) survivors++;
+  }
+  ASSERT_GE(survivors, kCacheSize / 4);
+  ASSERT_LE(survivors, kCacheSize / 2 + kCacheSize / 10);
+}
+
+TEST_F(CacheTest, HighPriorityWithoutPool) {
+  // Without a pool, the priority hint is ignored.
+  InsertHighPriority(1, 100);
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST_F(CacheTest, SegmentedScanResistance) {
+  delete cache_;
+  cache_ = NewSegmentedLRUCache(kCacheSize);
+
+  // Entries that were looked up survive a scan of entries seen only once
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  int scanned = 0;
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    if (Lookup(10000 + i) >= 0) scanned++;
+  }
+  ASSERT_LE(scanned, kCacheSize + kCacheSize / 10 - 100);
+}
+
+TEST_F(CacheTest, SegmentedHeavyEntries) {
+  delete cache_;
+  cache_ = NewSegmentedLRUCache(kCacheSize);
+
+  // The protected segment does not let the cache outgrow its capacity
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    Lookup(index);
+    added += weight;
+    index++;
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+  for (int i = index - 10; i < index; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+}
+
 TEST_F(CacheTest, ZeroSizeCache) {
   delete cache_;
   cache_ = NewLRUCache(0);
@@ -221,4 +313,157 @@ TEST_F(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize, 2, 1);
+  }
+};
+
+TEST_F(ClockCacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_F(ClockCacheTest, EntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_F(ClockCacheTest, EvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+  Cache::Handle* h = InsertAndReturnHandle(300, 301);
+
+  // Entries that are hit between turns of the clock hand are kept around,
+  // as are things that are still in use.
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(301, Lookup(300));
+  cache_->Release(h);
+}
+
+TEST_F(ClockCacheTest, HeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+    index++;
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+}
+
+TEST_F(ClockCacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST_F(ClockCacheTest, ZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0, 0, 1);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST_F(ClockCacheTest, FullTable) {
+  // Entries far smaller than estimated run out of slots before capacity
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 0, 100);
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < 100; i++) {
+    h.push_back(InsertAndReturnHandle(i, 1000 + i));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, DecodeValue(cache_->Value(h[i])));
+    cache_->Release(h[i]);
+  }
+  ASSERT_LT(cache_->TotalCharge(), 100);
+}
+
+static void DeleteString(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+TEST(ClockCacheConcurrencyTest, ReadersAndWriters) {
+  Cache* cache = NewClockCache(1000, 2, 1);
+  const int kKeys = 2000;
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([cache, t, &failed]() {
+      uint32_t x = t + 1;
+      for (int i = 0; i < 50000; i++) {
+        x = x * 1103515245 + 12345;
+        const int k = (x >> 8) % kKeys;
+        const std::string key = EncodeKey(k);
+        if (t % 4 == 0 && (x & 0xf) == 0) {
+          cache->Erase(key);
+        } else if (t % 4 == 0) {
+          cache->Release(cache->Insert(key, new std::string(key), 1,
+                                       &DeleteString));
+        } else {
+          Cache::Handle* h = cache->Lookup(key);
+          if (h != nullptr) {
+            if (*reinterpret_cast<std::string*>(cache->Value(h)) != key) {
+              failed.store(true);
+            }
+            cache->Release(h);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_FALSE(failed.load());
+  ASSERT_LE(cache->TotalCharge(), 1000 + 100);
+  delete cache;
+}
+
 }  // namespace leveldb
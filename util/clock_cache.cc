@@ -0,0 +1,444 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard keeps its entries in a fixed array of slots, an open addressing
+// hash table with linear probing.  Slots are never freed while the cache is
+// alive, so readers may look at any slot at any time; everything a reader
+// needs to know about a slot is in its atomic "meta" word:
+//
+//   bits 0..31   reference count of clients (and of in-flight lookups)
+//   bit 32       CLOCK usage bit, set by hits and cleared by the clock hand
+//   bits 33..34  state of the slot
+//
+// Lookup() and Release() only atomically update the meta words of the
+// slots they probe, so cache hits never lock.  Insert(), Erase(), Prune()
+// and evictions lock the shard; they change the state of slots and write
+// their other fields.  A slot moves through the states
+//
+//   kEmpty -> kConstruction -> kVisible [-> kInvisible] -> kConstruction
+//          -> kEmpty
+//
+// Readers only read the fields of a slot after they acquired a reference
+// to it in state kVisible or kInvisible, which keeps the slot from being
+// reclaimed.  A reader that raced with a state change simply drops its
+// reference again.  An erased slot that is still referenced turns
+// kInvisible, and is reclaimed by whoever drops its last reference.
+//
+// Probing is bounded with a per-slot count of the entries whose probe
+// sequence passes over the slot: a lookup stops at the first slot that no
+// probe sequence passes over.
+struct ClockHandle {
+  std::atomic<uint64_t> meta;
+  std::atomic<uint32_t> displacements;
+  uint32_t hash;
+  bool detached;  // Not in the cache; freed when released
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+const uint64_t kRefMask = 0xffffffffull;
+const uint64_t kUsageBit = 1ull << 32;
+const int kStateShift = 33;
+const uint64_t kStateMask = 3ull << kStateShift;
+
+enum SlotState : uint64_t {
+  kEmpty = 0,
+  kConstruction = 1,
+  kVisible = 2,
+  kInvisible = 3,
+};
+
+inline SlotState StateOf(uint64_t meta) {
+  return static_cast<SlotState>((meta & kStateMask) >> kStateShift);
+}
+
+inline uint64_t RefsOf(uint64_t meta) { return meta & kRefMask; }
+
+// A single shard of the cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard();
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of shards
+  void Init(size_t capacity, size_t num_slots);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        bool referenced);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(ClockHandle* h);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+
+ private:
+  // Drop a reference to "h", reclaiming it if it was the last reference to
+  // an erased entry.
+  void Unref(ClockHandle* h);
+
+  void SetState(ClockHandle* h, SlotState state)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the visible slot holding key/hash, if any, without taking a
+  // reference to it.
+  ClockHandle* FindVisible(const Slice& key, uint32_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // If "h" is unreferenced and in state "state", frees its entry and
+  // returns true.
+  bool TryReclaim(ClockHandle* h, SlotState state)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Advance the clock hand until an entry was evicted.  Returns false if
+  // every entry is in use.
+  bool EvictOne() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  size_t capacity_;
+  size_t num_slots_;     // A power of two
+  size_t max_occupied_;  // Bound on occupied_ that keeps probes short
+  ClockHandle* slots_;
+
+  std::atomic<size_t> usage_;
+
+  port::Mutex mutex_;
+  size_t occupied_ GUARDED_BY(mutex_);  // Slots that are not kEmpty
+  size_t clock_hand_ GUARDED_BY(mutex_);
+};
+
+ClockCacheShard::ClockCacheShard()
+    : capacity_(0),
+      num_slots_(0),
+      max_occupied_(0),
+      slots_(nullptr),
+      usage_(0),
+      occupied_(0),
+      clock_hand_(0) {}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (size_t i = 0; i < num_slots_; i++) {
+    ClockHandle* h = &slots_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+    assert(RefsOf(meta) == 0);  // Error if caller has an unreleased handle
+    if (StateOf(meta) == kVisible || StateOf(meta) == kInvisible) {
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+    }
+  }
+  delete[] slots_;
+}
+
+void ClockCacheShard::Init(size_t capacity, size_t num_slots) {
+  assert(slots_ == nullptr);
+  capacity_ = capacity;
+  num_slots_ = num_slots;
+  max_occupied_ = num_slots - num_slots / 4;
+  slots_ = new ClockHandle[num_slots];
+  for (size_t i = 0; i < num_slots; i++) {
+    slots_[i].meta.store(0, std::memory_order_relaxed);
+    slots_[i].displacements.store(0, std::memory_order_relaxed);
+    slots_[i].detached = false;
+    slots_[i].key_data = nullptr;
+  }
+}
+
+void ClockCacheShard::SetState(ClockHandle* h, SlotState state) {
+  // Readers may change the reference count and the usage bit concurrently
+  const uint64_t state_bits = static_cast<uint64_t>(state) << kStateShift;
+  uint64_t meta = h->meta.load(std::memory_order_relaxed);
+  while (!h->meta.compare_exchange_weak(meta, (meta & ~kStateMask) | state_bits,
+                                        std::memory_order_acq_rel,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  size_t index = hash & (num_slots_ - 1);
+  for (size_t probes = 0; probes < num_slots_; probes++) {
+    ClockHandle* h = &slots_[index];
+    if (StateOf(h->meta.load(std::memory_order_acquire)) == kVisible) {
+      const uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+      if (StateOf(old) == kVisible && h->hash == hash && h->key() == key) {
+        if ((old & kUsageBit) == 0) {
+          h->meta.fetch_or(kUsageBit, std::memory_order_relaxed);
+        }
+        return reinterpret_cast<Cache::Handle*>(h);
+      }
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+    index = (index + 1) & (num_slots_ - 1);
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Release(ClockHandle* h) { Unref(h); }
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+  assert(RefsOf(old) > 0);
+  if (RefsOf(old) == 1 && StateOf(old) == kInvisible) {
+    MutexLock l(&mutex_);
+    TryReclaim(h, kInvisible);
+  }
+}
+
+bool ClockCacheShard::TryReclaim(ClockHandle* h, SlotState state) {
+  uint64_t meta = h->meta.load(std::memory_order_acquire);
+  do {
+    if (StateOf(meta) != state || RefsOf(meta) != 0) {
+      return false;
+    }
+  } while (!h->meta.compare_exchange_weak(
+      meta, static_cast<uint64_t>(kConstruction) << kStateShift,
+      std::memory_order_acq_rel, std::memory_order_acquire));
+
+  // The slot is ours again: free the entry and unwind its probe sequence.
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  h->key_data = nullptr;
+  usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+  size_t index = h->hash & (num_slots_ - 1);
+  while (&slots_[index] != h) {
+    slots_[index].displacements.fetch_sub(1, std::memory_order_release);
+    index = (index + 1) & (num_slots_ - 1);
+  }
+  SetState(h, kEmpty);
+  occupied_--;
+  return true;
+}
+
+bool ClockCacheShard::EvictOne() {
+  // Two turns of the hand clear every usage bit on the way
+  for (size_t steps = 0; steps < 2 * num_slots_; steps++) {
+    ClockHandle* h = &slots_[clock_hand_];
+    clock_hand_ = (clock_hand_ + 1) & (num_slots_ - 1);
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) != kVisible || RefsOf(meta) != 0) {
+      continue;
+    }
+    if ((meta & kUsageBit) != 0) {
+      h->meta.fetch_and(~kUsageBit, std::memory_order_relaxed);
+    } else if (TryReclaim(h, kVisible)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+ClockHandle* ClockCacheShard::FindVisible(const Slice& key, uint32_t hash) {
+  size_t index = hash & (num_slots_ - 1);
+  for (size_t probes = 0; probes < num_slots_; probes++) {
+    ClockHandle* h = &slots_[index];
+    // Only we change states, so the fields of visible slots are stable
+    if (StateOf(h->meta.load(std::memory_order_acquire)) == kVisible &&
+        h->hash == hash && h->key() == key) {
+      return h;
+    }
+    if (h->displacements.load(std::memory_order_relaxed) == 0) {
+      break;
+    }
+    index = (index + 1) & (num_slots_ - 1);
+  }
+  return nullptr;
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value),
+                                       bool referenced) {
+  MutexLock l(&mutex_);
+
+  while ((usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+          occupied_ >= max_occupied_) &&
+         EvictOne()) {
+  }
+
+  ClockHandle* h = nullptr;
+  const bool detached = capacity_ == 0 || occupied_ >= max_occupied_;
+  if (!detached) {
+    // Claim the first empty slot of the probe sequence
+    size_t index = hash & (num_slots_ - 1);
+    while (StateOf(slots_[index].meta.load(std::memory_order_relaxed)) !=
+           kEmpty) {
+      slots_[index].displacements.fetch_add(1, std::memory_order_release);
+      index = (index + 1) & (num_slots_ - 1);
+    }
+    h = &slots_[index];
+    SetState(h, kConstruction);
+    occupied_++;
+  } else {
+    // Full of entries in use, or caching is turned off (capacity_==0).
+    h = new ClockHandle;
+    h->meta.store(0, std::memory_order_relaxed);
+    h->displacements.store(0, std::memory_order_relaxed);
+  }
+  h->hash = hash;
+  h->detached = detached;
+  h->value = value;
+  h->deleter = deleter;
+  h->charge = charge;
+  h->key_length = key.size();
+  h->key_data = new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+
+  if (detached) {
+    h->meta.store(1, std::memory_order_relaxed);  // for the returned handle
+    return reinterpret_cast<Cache::Handle*>(h);
+  }
+
+  ClockHandle* old = FindVisible(key, hash);
+  usage_.fetch_add(charge, std::memory_order_relaxed);
+  h->meta.fetch_add(1 | (referenced ? kUsageBit : 0),
+                    std::memory_order_relaxed);  // for the returned handle
+  SetState(h, kVisible);
+  if (old != nullptr) {
+    SetState(old, kInvisible);
+    TryReclaim(old, kInvisible);
+  }
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  MutexLock l(&mutex_);
+  ClockHandle* h = FindVisible(key, hash);
+  if (h != nullptr) {
+    SetState(h, kInvisible);
+    TryReclaim(h, kInvisible);
+  }
+}
+
+void ClockCacheShard::Prune() {
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < num_slots_; i++) {
+    TryReclaim(&slots_[i], kVisible);
+  }
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  const int num_shard_bits_;
+  ClockCacheShard* const shards_;
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  ClockCacheShard* Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? &shards_[0]
+                                : &shards_[hash >> (32 - num_shard_bits_)];
+  }
+
+ public:
+  ShardedClockCache(size_t capacity, int num_shard_bits,
+                    size_t estimated_entry_charge)
+      : num_shard_bits_(num_shard_bits),
+        shards_(new ClockCacheShard[1 << num_shard_bits]),
+        last_id_(0) {
+    const int num_shards = 1 << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    const size_t entries_per_shard =
+        per_shard / (estimated_entry_charge > 0 ? estimated_entry_charge : 1);
+    // Load factor of at most 1/2 at the estimated number of entries
+    size_t num_slots = 16;
+    while (num_slots < 2 * entries_per_shard) {
+      num_slots *= 2;
+    }
+    for (int s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, num_slots);
+    }
+  }
+  ~ShardedClockCache() override { delete[] shards_; }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    const uint32_t hash = HashSlice(key);
+    return Shard(hash)->Insert(key, hash, value, charge, deleter, false);
+  }
+  Handle* InsertWithPriority(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) override {
+    // High priority entries start out with their usage bit set, which
+    // lets them survive one more turn of the clock hand.
+    const uint32_t hash = HashSlice(key);
+    return Shard(hash)->Insert(key, hash, value, charge, deleter,
+                               priority == Priority::kHigh);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return Shard(hash)->Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    if (h->detached) {
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+      delete h;
+    } else {
+      Shard(h->hash)->Release(h);
+    }
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    Shard(hash)->Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  void Prune() override {
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < (1 << num_shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  assert(num_shard_bits >= 0 && num_shard_bits <= 16);
+  return new ShardedClockCache(capacity, num_shard_bits,
+                               estimated_entry_charge);
+}
+
+}  // namespace leveldb
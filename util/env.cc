@@ -22,16 +22,48 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::NewDirectRandomAccessFile(const std::string& fname,
+                                      RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
+Status Env::NewDirectWritableFile(const std::string& fname,
+                                  WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+Status Env::NewMmapRandomAccessFile(const std::string& fname,
+                                    RandomAccessFile** result) {
+  return NewRandomAccessFile(fname, result);
+}
+
 Status Env::RemoveDir(const std::string& dirname) { return DeleteDir(dirname); }
 Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::ScheduleWithPriority(void (*function)(void*), void* arg,
+                               Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
+void RandomAccessFile::MultiRead(ReadRequest* reqs, size_t num_reqs) const {
+  for (size_t i = 0; i < num_reqs; i++) {
+    reqs[i].status =
+        Read(reqs[i].offset, reqs[i].n, &reqs[i].result, reqs[i].scratch);
+  }
+}
+
+void RandomAccessFile::Hint(uint64_t offset, size_t n,
+                            AccessPattern pattern) const {}
+
 WritableFile::~WritableFile() = default;
 
 Logger::~Logger() = default;
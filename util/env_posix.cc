@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -21,6 +22,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <string>
@@ -36,6 +39,12 @@
 #include "util/env_posix_test_helper.h"
 #include "util/posix_logger.h"
 
+#if HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif  // HAVE_IO_URING
+
 namespace leveldb {
 
 namespace {
@@ -49,6 +58,13 @@ constexpr const int kDefaultMmapLimit = (sizeof(void*) >= 8) ? 1000 : 0;
 // Can be set using EnvPosixTestHelper::SetReadOnlyMMapLimit().
 int g_mmap_limit = kDefaultMmapLimit;
 
+// Can be cleared using EnvPosixTestHelper::SetUseIoUring() to make
+// MultiRead() use the read thread pool even where io_uring works.
+bool g_use_io_uring = true;
+
+// Number of threads that serve MultiRead() when io_uring is unavailable.
+constexpr const int kReadPoolThreads = 8;
+
 // Common flags defined for all posix open operations
 #if defined(HAVE_O_CLOEXEC)
 constexpr const int kOpenBaseFlags = O_CLOEXEC;
@@ -58,6 +74,27 @@ constexpr const int kOpenBaseFlags = 0;
 
 constexpr const size_t kWritableFileBufferSize = 65536;
 
+// Files opened for direct I/O bypass the page cache: with O_DIRECT where
+// it exists, and with fcntl(F_NOCACHE) on macOS.
+#if defined(O_DIRECT)
+constexpr const int kOpenDirectFlags = O_DIRECT;
+#else
+constexpr const int kOpenDirectFlags = 0;
+#endif  // defined(O_DIRECT)
+
+// Offsets, sizes and buffers of direct I/O are multiples of this, which
+// covers the logical block size of common devices.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+// Direct writes reach the file in chunks of this size.
+constexpr const size_t kDirectWritableFileBufferSize = 1 << 20;
+
+// Up to this size, the bounce buffer of a direct read is kept by the file
+// for its next read, which covers the adaptive read-ahead windows of table
+// iterators.  Larger reads allocate a buffer each time rather than pin that
+// much memory per open file.
+constexpr const size_t kMaxKeptDirectReadBufferSize = 256 * 1024;
+
 Status PosixError(const std::string& context, int error_number) {
   if (error_number == ENOENT) {
     return Status::NotFound(context, std::strerror(error_number));
@@ -129,6 +166,379 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+class ThreadPool;
+
+// Reads n bytes at offset from fd, as RandomAccessFile::Read() does.
+Status PosixPread(int fd, const std::string& filename, uint64_t offset,
+                  size_t n, Slice* result, char* scratch) {
+  ::ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
+  *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
+  if (read_size < 0) {
+    // An error: return a non-ok status.
+    return PosixError(filename, errno);
+  }
+  return Status::OK();
+}
+
+#if defined(POSIX_FADV_NORMAL)
+int FadviseAdvice(RandomAccessFile::AccessPattern pattern) {
+  switch (pattern) {
+    case RandomAccessFile::kRandom:
+      return POSIX_FADV_RANDOM;
+    case RandomAccessFile::kSequential:
+      return POSIX_FADV_SEQUENTIAL;
+    case RandomAccessFile::kWillNeed:
+      return POSIX_FADV_WILLNEED;
+    default:
+      return POSIX_FADV_NORMAL;
+  }
+}
+#endif  // defined(POSIX_FADV_NORMAL)
+
+int MadviseAdvice(RandomAccessFile::AccessPattern pattern) {
+  switch (pattern) {
+    case RandomAccessFile::kRandom:
+      return MADV_RANDOM;
+    case RandomAccessFile::kSequential:
+      return MADV_SEQUENTIAL;
+    case RandomAccessFile::kWillNeed:
+      return MADV_WILLNEED;
+    default:
+      return MADV_NORMAL;
+  }
+}
+
+// Opens filename for direct I/O.  Returns -1 and sets errno on failure.
+// errno is EINVAL if the file system does not support direct I/O.
+int OpenDirect(const std::string& filename, int flags, ::mode_t mode) {
+  int fd = ::open(filename.c_str(), flags | kOpenDirectFlags, mode);
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+  if (fd >= 0 && ::fcntl(fd, F_NOCACHE, 1) == -1) {
+    const int error_number = errno;
+    ::close(fd);
+    errno = error_number;
+    fd = -1;
+  }
+#endif  // !defined(O_DIRECT) && defined(F_NOCACHE)
+  return fd;
+}
+
+// Returns the status of a failed OpenDirect() of filename.
+Status DirectOpenError(const std::string& filename, int error_number) {
+  if (error_number == EINVAL) {
+    return Status::NotSupported(filename, "direct I/O");
+  }
+  return PosixError(filename, error_number);
+}
+
+// Returns size bytes aligned for direct I/O, to be released with free(),
+// or nullptr if they cannot be allocated.
+char* NewAlignedBuffer(size_t size) {
+  void* buf = nullptr;
+  if (::posix_memalign(&buf, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return reinterpret_cast<char*>(buf);
+}
+
+Status AlignedBufferError(const std::string& filename) {
+  return Status::IOError(filename, "cannot allocate a direct I/O buffer");
+}
+
+size_t RoundUpToAlignment(size_t n) {
+  return (n + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+}
+
+// Size of the aligned range around [offset, offset + n).
+size_t DirectReadSize(uint64_t offset, size_t n) {
+  return RoundUpToAlignment(
+      static_cast<size_t>(offset & (kDirectIOAlignment - 1)) + n);
+}
+
+// Like PosixPread(), for a file opened for direct I/O.  Reads the aligned
+// range around [offset, offset + n) into |buf|, an aligned bounce buffer
+// of at least DirectReadSize(offset, n) bytes, and copies the requested
+// bytes to scratch.
+Status PosixDirectPread(int fd, const std::string& filename, uint64_t offset,
+                        size_t n, char* buf, Slice* result, char* scratch) {
+  const uint64_t aligned_offset = offset & ~(kDirectIOAlignment - 1);
+  const size_t skip = static_cast<size_t>(offset - aligned_offset);
+  const size_t aligned_size = DirectReadSize(offset, n);
+  Status status;
+  size_t read_size = 0;
+  while (read_size < aligned_size) {
+    ::ssize_t r = ::pread(fd, buf + read_size, aligned_size - read_size,
+                          static_cast<off_t>(aligned_offset + read_size));
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;  // Retry
+      }
+      status = PosixError(filename, errno);
+      break;
+    }
+    read_size += r;
+    if (r == 0 || read_size % kDirectIOAlignment != 0) {
+      break;  // End of file
+    }
+  }
+  n = (read_size > skip) ? std::min(n, read_size - skip) : 0;
+  std::memcpy(scratch, buf + skip, n);
+  *result = Slice(scratch, status.ok() ? n : 0);
+  return status;
+}
+
+#if HAVE_IO_URING && defined(__NR_io_uring_setup)
+
+// A submission and completion queue pair for batched reads, driven
+// through the raw system calls so that there is no dependency on
+// liburing.  Every thread that calls MultiRead() gets its own ring (see
+// ThreadIoUring()), so the queues need no locking.
+class IoUring {
+ public:
+  // The most reads that Read() accepts at once.
+  static constexpr const size_t kQueueDepth = 64;
+
+  IoUring()
+      : ring_fd_(-1),
+        broken_(false),
+        sq_ring_(nullptr),
+        cq_ring_(nullptr),
+        sqes_(nullptr),
+        sq_ring_size_(0),
+        cq_ring_size_(0),
+        sqes_size_(0) {}
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      ::munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+      ::close(ring_fd_);
+    }
+  }
+
+  bool initialized() const { return ring_fd_ >= 0; }
+
+  // True once waiting for completions has failed.  Reads may still be in
+  // flight then, so the ring is never used again.
+  bool broken() const { return broken_; }
+
+  // Set up the ring.  Returns false if the kernel does not support
+  // io_uring or refuses to create one.
+  bool Init() {
+    ::io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(
+        ::syscall(__NR_io_uring_setup, kQueueDepth, &params));
+    if (fd < 0) {
+      return false;
+    }
+    ring_fd_ = fd;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+    bool single_mmap = false;
+#if defined(IORING_FEAT_SINGLE_MMAP)
+    single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif  // defined(IORING_FEAT_SINGLE_MMAP)
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      return Fail();
+    }
+    cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == nullptr) {
+      return Fail();
+    }
+    sqes_size_ = params.sq_entries * sizeof(::io_uring_sqe);
+    sqes_ = Map(sqes_size_, IORING_OFF_SQES);
+    if (sqes_ == nullptr) {
+      return Fail();
+    }
+
+    sq_head_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_ring_ + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<::io_uring_cqe*>(cq_ring_ + params.cq_off.cqes);
+    return true;
+  }
+
+  // Perform reqs[0,n-1] against fd, with all of them in flight at once.
+  // Returns false, without having read anything, if the requests could
+  // not be submitted.  If the kernel rejects the requests after some of
+  // them went in flight, the others fail with its error.
+  //
+  // REQUIRES: n <= kQueueDepth
+  bool Read(int fd, const std::string& filename, ReadRequest* reqs,
+            size_t n) {
+    assert(n <= kQueueDepth);
+    const unsigned old_tail = *sq_tail_;
+    unsigned tail = old_tail;
+    for (size_t i = 0; i < n; i++) {
+      const unsigned index = tail & sq_mask_;
+      ::io_uring_sqe* sqe =
+          reinterpret_cast<::io_uring_sqe*>(sqes_) + index;
+      std::memset(sqe, 0, sizeof(*sqe));
+      iovecs_[i].iov_base = reqs[i].scratch;
+      iovecs_[i].iov_len = reqs[i].n;
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&iovecs_[i]);
+      sqe->len = 1;
+      sqe->off = reqs[i].offset;
+      sqe->user_data = i;
+      done_[i] = false;
+      sq_array_[index] = index;
+      tail++;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    size_t submitted = 0;
+    size_t completed = 0;
+    size_t expected = n;  // Reads that will complete
+    while (completed < expected) {
+      int ret = static_cast<int>(
+          ::syscall(__NR_io_uring_enter, ring_fd_, expected - submitted, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (ret < 0) {
+        const int error_number = errno;
+        if (error_number == EINTR || error_number == EAGAIN ||
+            error_number == EBUSY) {
+          continue;
+        }
+        if (submitted == 0) {
+          // Nothing reached the kernel; take the entries back.
+          __atomic_store_n(sq_tail_, old_tail, __ATOMIC_RELEASE);
+          return false;
+        }
+        if (submitted < expected) {
+          // Drop the entries the kernel has not taken and wait for the
+          // reads in flight only.
+          const unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+          __atomic_store_n(sq_tail_, head, __ATOMIC_RELEASE);
+          for (size_t i = submitted; i < expected; i++) {
+            reqs[i].result = Slice(reqs[i].scratch, 0);
+            reqs[i].status = PosixError(filename, error_number);
+          }
+          expected = submitted;
+          continue;
+        }
+        // Cannot wait for the reads in flight.
+        broken_ = true;
+        for (size_t i = 0; i < n; i++) {
+          if (!done_[i]) {
+            reqs[i].result = Slice(reqs[i].scratch, 0);
+            reqs[i].status = PosixError(filename, error_number);
+          }
+        }
+        return true;
+      }
+      submitted += ret;
+
+      unsigned head = *cq_head_;
+      while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        const ::io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        Complete(fd, filename, &reqs[cqe.user_data], cqe.res);
+        done_[cqe.user_data] = true;
+        head++;
+        completed++;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+
+ private:
+  char* Map(size_t size, off_t offset) {
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return base == MAP_FAILED ? nullptr : reinterpret_cast<char*>(base);
+  }
+
+  bool Fail() {
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+    return false;
+  }
+
+  static void Complete(int fd, const std::string& filename, ReadRequest* req,
+                       int res) {
+    if (res < 0) {
+      req->result = Slice(req->scratch, 0);
+      req->status = PosixError(filename, -res);
+    } else if (res > 0 && static_cast<size_t>(res) < req->n) {
+      // Short read in the middle of the file.  Finish it synchronously,
+      // so that the outcome matches that of Read().
+      Slice rest;
+      req->status = PosixPread(fd, filename, req->offset + res, req->n - res,
+                               &rest, req->scratch + res);
+      req->result = Slice(req->scratch, res + rest.size());
+    } else {
+      req->result = Slice(req->scratch, res);
+      req->status = Status::OK();
+    }
+  }
+
+  int ring_fd_;
+  bool broken_;
+  char* sq_ring_;
+  char* cq_ring_;
+  char* sqes_;
+  size_t sq_ring_size_;
+  size_t cq_ring_size_;
+  size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  ::io_uring_cqe* cqes_;
+
+  ::iovec iovecs_[kQueueDepth];
+  bool done_[kQueueDepth];  // Whether each request of Read() completed
+};
+
+constexpr const size_t IoUring::kQueueDepth;
+
+// Returns the calling thread's ring, or nullptr if io_uring is unavailable
+// or disabled.
+IoUring* ThreadIoUring() {
+  static std::atomic<bool> unavailable(false);
+  if (!g_use_io_uring || unavailable.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  static thread_local IoUring ring;
+  if (ring.broken()) {
+    return nullptr;
+  }
+  if (!ring.initialized() && !ring.Init()) {
+    unavailable.store(true, std::memory_order_relaxed);
+    return nullptr;
+  }
+  return &ring;
+}
+
+#endif  // HAVE_IO_URING && defined(__NR_io_uring_setup)
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -176,12 +586,19 @@ class PosixSequentialFile final : public SequentialFile {
 class PosixRandomAccessFile final : public RandomAccessFile {
  public:
   // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
-  // instance, and will be used to determine if .
-  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter)
+  // instance, and will be used to determine if . |read_pool| must outlive
+  // this instance, and serves MultiRead() when io_uring is unavailable.
+  // |direct| is true if |fd| was opened with OpenDirect().
+  PosixRandomAccessFile(std::string filename, int fd, Limiter* fd_limiter,
+                        ThreadPool* read_pool, bool direct)
       : has_permanent_fd_(fd_limiter->Acquire()),
         fd_(has_permanent_fd_ ? fd : -1),
+        direct_(direct),
         fd_limiter_(fd_limiter),
-        filename_(std::move(filename)) {
+        read_pool_(read_pool),
+        filename_(std::move(filename)),
+        direct_buf_(nullptr),
+        direct_buf_size_(0) {
     if (!has_permanent_fd_) {
       assert(fd_ == -1);
       ::close(fd);  // The file will be opened on every read.
@@ -194,13 +611,14 @@ class PosixRandomAccessFile final : public RandomAccessFile {
       ::close(fd_);
       fd_limiter_->Release();
     }
+    std::free(direct_buf_);
   }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
               char* scratch) const override {
     int fd = fd_;
     if (!has_permanent_fd_) {
-      fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+      fd = Open();
       if (fd < 0) {
         return PosixError(filename_, errno);
       }
@@ -208,13 +626,9 @@ class PosixRandomAccessFile final : public RandomAccessFile {
 
     assert(fd != -1);
 
-    Status status;
-    ssize_t read_size = ::pread(fd, scratch, n, static_cast<off_t>(offset));
-    *result = Slice(scratch, (read_size < 0) ? 0 : read_size);
-    if (read_size < 0) {
-      // An error: return a non-ok status.
-      status = PosixError(filename_, errno);
-    }
+    Status status = direct_
+                        ? DirectRead(fd, offset, n, result, scratch)
+                        : PosixPread(fd, filename_, offset, n, result, scratch);
     if (!has_permanent_fd_) {
       // Close the temporary file descriptor opened earlier.
       assert(fd != fd_);
@@ -223,11 +637,53 @@ class PosixRandomAccessFile final : public RandomAccessFile {
     return status;
   }
 
+  // Uses io_uring where the kernel supports it, and otherwise spreads the
+  // reads over the calling thread and the threads of |read_pool_|.  Direct
+  // reads are performed one after the other.
+  void MultiRead(ReadRequest* reqs, size_t num_reqs) const override;
+
+  // Passed on to posix_fadvise(), unless the file is read with direct I/O
+  // or has no permanent file descriptor.
+  void Hint(uint64_t offset, size_t n, AccessPattern pattern) const override {
+#if defined(POSIX_FADV_NORMAL)
+    if (has_permanent_fd_ && !direct_) {
+      ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(n),
+                      FadviseAdvice(pattern));
+    }
+#endif  // defined(POSIX_FADV_NORMAL)
+  }
+
  private:
+  // Opens a temporary file descriptor for a read.
+  int Open() const {
+    const int flags = O_RDONLY | kOpenBaseFlags;
+    return direct_ ? OpenDirect(filename_, flags, 0)
+                   : ::open(filename_.c_str(), flags);
+  }
+
+  // Perform reqs[0,num_reqs-1] against fd with pread() from several
+  // threads.
+  void ParallelRead(int fd, ReadRequest* reqs, size_t num_reqs) const;
+
+  // Read() for a file opened for direct I/O.  Borrows the bounce buffer
+  // of the file if no other read is using it, and allocates one of its
+  // own otherwise.
+  Status DirectRead(int fd, uint64_t offset, size_t n, Slice* result,
+                    char* scratch) const;
+
   const bool has_permanent_fd_;  // If false, the file is opened on every read.
   const int fd_;                 // -1 if has_permanent_fd_ is false.
+  const bool direct_;            // True if reads bypass the page cache.
   Limiter* const fd_limiter_;
+  ThreadPool* const read_pool_;
   const std::string filename_;
+
+  // Bounce buffer kept for the next direct read, if any.  Read() is const
+  // and may run concurrently, so a read takes the buffer out while it
+  // uses it.
+  mutable port::Mutex direct_buf_mu_;
+  mutable char* direct_buf_ GUARDED_BY(direct_buf_mu_);
+  mutable size_t direct_buf_size_ GUARDED_BY(direct_buf_mu_);
 };
 
 // Implements random read access in a file using mmap().
@@ -243,7 +699,8 @@ class PosixMmapReadableFile final : public RandomAccessFile {
   //
   // |mmap_limiter| must outlive this instance. The caller must have already
   // acquired the right to use one mmap region, which will be released when this
-  // instance is destroyed.
+  // instance is destroyed. |mmap_limiter| is null if the region does not count
+  // against a limit.
   PosixMmapReadableFile(std::string filename, char* mmap_base, size_t length,
                         Limiter* mmap_limiter)
       : mmap_base_(mmap_base),
@@ -253,7 +710,9 @@ class PosixMmapReadableFile final : public RandomAccessFile {
 
   ~PosixMmapReadableFile() override {
     ::munmap(static_cast<void*>(mmap_base_), length_);
-    mmap_limiter_->Release();
+    if (mmap_limiter_ != nullptr) {
+      mmap_limiter_->Release();
+    }
   }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
@@ -267,6 +726,33 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  // Asks the kernel to page in the ranges of all the requests before
+  // reading them in place, so that their page faults do not wait for the
+  // device one after another.
+  void MultiRead(ReadRequest* reqs, size_t num_reqs) const override {
+    if (num_reqs > 1) {
+      for (size_t i = 0; i < num_reqs; i++) {
+        if (reqs[i].n > 0) {
+          Hint(reqs[i].offset, reqs[i].n, kWillNeed);
+        }
+      }
+    }
+    RandomAccessFile::MultiRead(reqs, num_reqs);
+  }
+
+  // Passed on to madvise() for the pages that hold the range.
+  void Hint(uint64_t offset, size_t n, AccessPattern pattern) const override {
+    if (offset >= length_) {
+      return;
+    }
+    if (n == 0 || n > length_ - offset) {
+      n = length_ - offset;
+    }
+    static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+    const size_t start = offset - offset % page_size;
+    ::madvise(mmap_base_ + start, offset + n - start, MadviseAdvice(pattern));
+  }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -454,6 +940,8 @@ class PosixWritableFile final : public WritableFile {
     return Basename(filename).starts_with("MANIFEST");
   }
 
+  friend class PosixDirectWritableFile;
+
   // buf_[0, pos_ - 1] contains data to be written to fd_.
   char buf_[kWritableFileBufferSize];
   size_t pos_;
@@ -464,6 +952,121 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+// Writes to a file opened with OpenDirect().  Appends are gathered in an
+// aligned buffer that is written out whenever it fills up.  The partial
+// block at the end of the data is written padded with zeros on Sync() and
+// Close(), after which the file is truncated to the size of the data; the
+// block stays in the buffer and is written again once it has grown.
+//
+// Flush() does nothing, so the data only becomes visible to readers of the
+// file on Sync() or Close().
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  // Takes ownership of |buf|, which must hold kDirectWritableFileBufferSize
+  // bytes aligned for direct I/O.
+  PosixDirectWritableFile(std::string filename, int fd, char* buf)
+      : buf_(buf),
+        pos_(0),
+        file_offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      size_t copy_size =
+          std::min(write_size, kDirectWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kDirectWritableFileBufferSize) {
+        Status status = WriteAligned(kDirectWritableFileBufferSize);
+        if (!status.ok()) {
+          return status;
+        }
+        file_offset_ += kDirectWritableFileBufferSize;
+        pos_ = 0;
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteTail();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  Status Flush() override { return Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteTail();
+    if (!status.ok()) {
+      return status;
+    }
+    return PosixWritableFile::SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Writes buf_[0, size - 1] at file_offset_.
+  //
+  // REQUIRES: size is a multiple of kDirectIOAlignment
+  Status WriteAligned(size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      ssize_t write_result =
+          ::pwrite(fd_, buf_ + written, size - written,
+                   static_cast<off_t>(file_offset_ + written));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      written += write_result;
+    }
+    return Status::OK();
+  }
+
+  // Writes the buffered data, then cuts off the padding of its last block.
+  Status WriteTail() {
+    if (pos_ == 0) {
+      return Status::OK();
+    }
+    const size_t aligned_size = RoundUpToAlignment(pos_);
+    std::memset(buf_ + pos_, 0, aligned_size - pos_);
+    Status status = WriteAligned(aligned_size);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(file_offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  // buf_[0, pos_ - 1] contains data to be written at file_offset_, which is
+  // a multiple of kDirectIOAlignment.
+  char* const buf_;
+  size_t pos_;
+  uint64_t file_offset_;
+  int fd_;
+
+  const std::string filename_;
+};
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -515,6 +1118,267 @@ class PosixLockTable {
   std::set<std::string> locked_files_ GUARDED_BY(mu_);
 };
 
+// A FIFO queue of background work items, served by a resizable set of
+// detached threads.  Threads are started lazily, the first time work is
+// scheduled after the pool has grown.  Like PosixEnv, which owns the
+// pools, a ThreadPool must never be destroyed.
+class ThreadPool {
+ public:
+  ThreadPool()
+      : background_work_cv_(&background_work_mutex_),
+        target_threads_(1),
+        running_threads_(0) {}
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg);
+
+  void SetBackgroundThreads(int number);
+
+ private:
+  void BackgroundThreadMain();
+
+  static void BackgroundThreadEntryPoint(ThreadPool* pool) {
+    pool->BackgroundThreadMain();
+  }
+
+  // Stores the work item data in a Schedule() call.
+  //
+  // Instances are constructed on the thread calling Schedule() and used on the
+  // background thread.
+  //
+  // This structure is thread-safe because it is immutable.
+  struct BackgroundWorkItem {
+    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
+        : function(function), arg(arg) {}
+
+    void (*const function)(void*);
+    void* const arg;
+  };
+
+  port::Mutex background_work_mutex_;
+  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
+  int target_threads_ GUARDED_BY(background_work_mutex_);
+  int running_threads_ GUARDED_BY(background_work_mutex_);
+
+  std::queue<BackgroundWorkItem> background_work_queue_
+      GUARDED_BY(background_work_mutex_);
+};
+
+void ThreadPool::Schedule(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg) {
+  background_work_mutex_.Lock();
+
+  // Start background threads, if we haven't done so already.
+  while (running_threads_ < target_threads_) {
+    running_threads_++;
+    std::thread background_thread(ThreadPool::BackgroundThreadEntryPoint,
+                                  this);
+    background_thread.detach();
+  }
+
+  background_work_queue_.emplace(background_work_function, background_work_arg);
+  background_work_cv_.Signal();
+  background_work_mutex_.Unlock();
+}
+
+void ThreadPool::SetBackgroundThreads(int number) {
+  background_work_mutex_.Lock();
+  target_threads_ = std::max(number, 1);
+  // Wake idle threads so that any surplus ones exit.
+  background_work_cv_.SignalAll();
+  background_work_mutex_.Unlock();
+}
+
+void ThreadPool::BackgroundThreadMain() {
+  while (true) {
+    background_work_mutex_.Lock();
+
+    // Wait until there is work to be done, or this thread is no longer
+    // needed.
+    while (background_work_queue_.empty() &&
+           running_threads_ <= target_threads_) {
+      background_work_cv_.Wait();
+    }
+    if (running_threads_ > target_threads_) {
+      running_threads_--;
+      background_work_mutex_.Unlock();
+      return;
+    }
+
+    assert(!background_work_queue_.empty());
+    auto background_work_function = background_work_queue_.front().function;
+    void* background_work_arg = background_work_queue_.front().arg;
+    background_work_queue_.pop();
+
+    background_work_mutex_.Unlock();
+    background_work_function(background_work_arg);
+  }
+}
+
+// The state of one ParallelRead(), shared by the calling thread and the
+// pool threads that help it.  Helpers that start after every request has
+// been claimed just drop their reference.
+struct ParallelReadState {
+  ParallelReadState(int fd, const std::string* filename, ReadRequest* reqs,
+                    size_t num_reqs)
+      : fd(fd),
+        filename(filename),
+        reqs(reqs),
+        num_reqs(num_reqs),
+        next(0),
+        done_cv(&mu),
+        done(0) {}
+
+  // Perform unclaimed requests until there are none left.
+  void Work() {
+    size_t finished = 0;
+    size_t i;
+    while ((i = next.fetch_add(1, std::memory_order_relaxed)) < num_reqs) {
+      ReadRequest* req = &reqs[i];
+      req->status = PosixPread(fd, *filename, req->offset, req->n,
+                               &req->result, req->scratch);
+      finished++;
+    }
+    if (finished > 0) {
+      mu.Lock();
+      done += finished;
+      if (done == num_reqs) {
+        done_cv.SignalAll();
+      }
+      mu.Unlock();
+    }
+  }
+
+  void WaitForAll() {
+    mu.Lock();
+    while (done < num_reqs) {
+      done_cv.Wait();
+    }
+    mu.Unlock();
+  }
+
+  const int fd;
+  const std::string* const filename;
+  ReadRequest* const reqs;
+  const size_t num_reqs;
+  std::atomic<size_t> next;
+
+  port::Mutex mu;
+  port::CondVar done_cv GUARDED_BY(mu);
+  size_t done GUARDED_BY(mu);
+};
+
+void ParallelReadWork(void* arg) {
+  std::shared_ptr<ParallelReadState>* state =
+      reinterpret_cast<std::shared_ptr<ParallelReadState>*>(arg);
+  (*state)->Work();
+  delete state;
+}
+
+void PosixRandomAccessFile::MultiRead(ReadRequest* reqs,
+                                      size_t num_reqs) const {
+  if (num_reqs <= 1 || direct_) {
+    RandomAccessFile::MultiRead(reqs, num_reqs);
+    return;
+  }
+
+  int fd = fd_;
+  if (!has_permanent_fd_) {
+    fd = Open();
+    if (fd < 0) {
+      const Status status = PosixError(filename_, errno);
+      for (size_t i = 0; i < num_reqs; i++) {
+        reqs[i].result = Slice();
+        reqs[i].status = status;
+      }
+      return;
+    }
+  }
+
+  size_t done = 0;
+#if HAVE_IO_URING && defined(__NR_io_uring_setup)
+  IoUring* ring = ThreadIoUring();
+  while (ring != nullptr && !ring->broken() && done < num_reqs) {
+    const size_t n = std::min(num_reqs - done, IoUring::kQueueDepth);
+    if (!ring->Read(fd, filename_, reqs + done, n)) {
+      break;
+    }
+    done += n;
+  }
+#endif  // HAVE_IO_URING && defined(__NR_io_uring_setup)
+  if (done < num_reqs) {
+    ParallelRead(fd, reqs + done, num_reqs - done);
+  }
+
+  if (!has_permanent_fd_) {
+    // Close the temporary file descriptor opened earlier.
+    assert(fd != fd_);
+    ::close(fd);
+  }
+}
+
+Status PosixRandomAccessFile::DirectRead(int fd, uint64_t offset, size_t n,
+                                         Slice* result, char* scratch) const {
+  const size_t size = DirectReadSize(offset, n);
+  char* buf = nullptr;
+  size_t buf_size = 0;
+  direct_buf_mu_.Lock();
+  std::swap(buf, direct_buf_);
+  std::swap(buf_size, direct_buf_size_);
+  direct_buf_mu_.Unlock();
+  if (buf_size < size) {
+    std::free(buf);
+    buf = NewAlignedBuffer(size);
+    if (buf == nullptr) {
+      *result = Slice();
+      return AlignedBufferError(filename_);
+    }
+    buf_size = size;
+  }
+
+  Status status =
+      PosixDirectPread(fd, filename_, offset, n, buf, result, scratch);
+
+  // Keep the buffer for the next read unless another read has put one
+  // back already or it is too large to keep around.
+  if (buf_size <= kMaxKeptDirectReadBufferSize) {
+    direct_buf_mu_.Lock();
+    if (direct_buf_ == nullptr) {
+      direct_buf_ = buf;
+      direct_buf_size_ = buf_size;
+      buf = nullptr;
+    }
+    direct_buf_mu_.Unlock();
+  }
+  std::free(buf);
+  return status;
+}
+
+void PosixRandomAccessFile::ParallelRead(int fd, ReadRequest* reqs,
+                                         size_t num_reqs) const {
+  // The pool only gets its threads once io_uring has turned out to be
+  // unavailable (or disabled), which is the first time it is needed.
+  static std::once_flag pool_sized;
+  ThreadPool* const pool = read_pool_;
+  std::call_once(pool_sized,
+                 [pool]() { pool->SetBackgroundThreads(kReadPoolThreads); });
+
+  std::shared_ptr<ParallelReadState> state =
+      std::make_shared<ParallelReadState>(fd, &filename_, reqs, num_reqs);
+  const size_t helpers =
+      std::min(num_reqs - 1, static_cast<size_t>(kReadPoolThreads));
+  for (size_t i = 0; i < helpers; i++) {
+    read_pool_->Schedule(&ParallelReadWork,
+                         new std::shared_ptr<ParallelReadState>(state));
+  }
+  state->Work();
+  state->WaitForAll();
+}
+
 class PosixEnv : public Env {
  public:
   PosixEnv();
@@ -546,30 +1410,28 @@ class PosixEnv : public Env {
     }
 
     if (!mmap_limiter_.Acquire()) {
-      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_);
+      *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                          &read_pool_, false);
       return Status::OK();
     }
 
-    uint64_t file_size;
-    Status status = GetFileSize(filename, &file_size);
-    if (status.ok()) {
-      void* mmap_base =
-          ::mmap(/*addr=*/nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
-      if (mmap_base != MAP_FAILED) {
-        *result = new PosixMmapReadableFile(filename,
-                                            reinterpret_cast<char*>(mmap_base),
-                                            file_size, &mmap_limiter_);
-      } else {
-        status = PosixError(filename, errno);
-      }
-    }
-    ::close(fd);
+    Status status = MmapFile(filename, fd, &mmap_limiter_, result);
     if (!status.ok()) {
       mmap_limiter_.Release();
     }
     return status;
   }
 
+  Status NewMmapRandomAccessFile(const std::string& filename,
+                                 RandomAccessFile** result) override {
+    *result = nullptr;
+    int fd = ::open(filename.c_str(), O_RDONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      return PosixError(filename, errno);
+    }
+    return MmapFile(filename, fd, nullptr, result);
+  }
+
   Status NewWritableFile(const std::string& filename,
                          WritableFile** result) override {
     int fd = ::open(filename.c_str(),
@@ -596,6 +1458,38 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+    *result = nullptr;
+    int fd = OpenDirect(filename, O_RDONLY | kOpenBaseFlags, 0);
+    if (fd < 0) {
+      return DirectOpenError(filename, errno);
+    }
+
+    *result = new PosixRandomAccessFile(filename, fd, &fd_limiter_,
+                                        &read_pool_, true);
+    return Status::OK();
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+    *result = nullptr;
+    char* buf = NewAlignedBuffer(kDirectWritableFileBufferSize);
+    if (buf == nullptr) {
+      return AlignedBufferError(filename);
+    }
+    int fd = OpenDirect(filename, O_TRUNC | O_WRONLY | O_CREAT | kOpenBaseFlags,
+                        0644);
+    if (fd < 0) {
+      const Status status = DirectOpenError(filename, errno);
+      std::free(buf);
+      return status;
+    }
+
+    *result = new PosixDirectWritableFile(filename, fd, buf);
+    return Status::OK();
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -689,7 +1583,19 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    ScheduleWithPriority(background_work_function, background_work_arg, kLow);
+  }
+
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority pri) override {
+    thread_pools_[pri].Schedule(background_work_function, background_work_arg);
+  }
+
+  void SetBackgroundThreads(int number, Priority pri) override {
+    thread_pools_[pri].SetBackgroundThreads(number);
+  }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -745,32 +1651,29 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+  // Maps the file that fd refers to and stores a reader of the mapping in
+  // *result.  Closes fd.  |mmap_limiter| is passed on to the reader.
+  Status MmapFile(const std::string& filename, int fd, Limiter* mmap_limiter,
+                  RandomAccessFile** result) {
+    uint64_t file_size;
+    Status status = GetFileSize(filename, &file_size);
+    if (status.ok()) {
+      void* mmap_base =
+          ::mmap(/*addr=*/nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mmap_base != MAP_FAILED) {
+        *result = new PosixMmapReadableFile(filename,
+                                            reinterpret_cast<char*>(mmap_base),
+                                            file_size, mmap_limiter);
+      } else {
+        status = PosixError(filename, errno);
+      }
+    }
+    ::close(fd);
+    return status;
   }
 
-  // Stores the work item data in a Schedule() call.
-  //
-  // Instances are constructed on the thread calling Schedule() and used on the
-  // background thread.
-  //
-  // This structure is thread-safe because it is immutable.
-  struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
-
-    void (*const function)(void*);
-    void* const arg;
-  };
-
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
-
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  ThreadPool thread_pools_[2];  // Indexed by Priority; thread-safe.
+  ThreadPool read_pool_;        // Serves MultiRead(); thread-safe.
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -806,50 +1709,7 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
-      fd_limiter_(MaxOpenFiles()) {}
-
-void PosixEnv::Schedule(
-    void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
-  background_work_mutex_.Lock();
-
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
-  }
-
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
-
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
-}
-
-void PosixEnv::BackgroundThreadMain() {
-  while (true) {
-    background_work_mutex_.Lock();
-
-    // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
-    }
-
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
-
-    background_work_mutex_.Unlock();
-    background_work_function(background_work_arg);
-  }
-}
+    : mmap_limiter_(MaxMmaps()), fd_limiter_(MaxOpenFiles()) {}
 
 namespace {
 
@@ -922,6 +1782,10 @@ void EnvPosixTestHelper::SetReadOnlyMMapLimit(int limit) {
   g_mmap_limit = limit;
 }
 
+void EnvPosixTestHelper::SetUseIoUring(bool use_io_uring) {
+  g_use_io_uring = use_io_uring;
+}
+
 Env* Env::Default() {
   static PosixDefaultEnv env_container;
   return env_container.env();
@@ -6,6 +6,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -16,7 +17,9 @@
 #include "gtest/gtest.h"
 #include "leveldb/env.h"
 #include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/env_posix_test_helper.h"
+#include "util/mutexlock.h"
 #include "util/testutil.h"
 
 #if HAVE_O_CLOEXEC
@@ -176,6 +179,10 @@ class EnvPosixTest : public testing::Test {
     EnvPosixTestHelper::SetReadOnlyMMapLimit(mmap_limit);
   }
 
+  static void SetUseIoUring(bool use_io_uring) {
+    EnvPosixTestHelper::SetUseIoUring(use_io_uring);
+  }
+
   EnvPosixTest() : env_(Env::Default()) {}
 
   Env* env_;
@@ -212,6 +219,217 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, MultiRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/multi_read.txt";
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    data.append(std::to_string(i));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Use up the mmap regions so that the last file is read with pread().
+  const int kNumFiles = kMMapLimit + 1;
+  leveldb::RandomAccessFile* files[kNumFiles] = {0};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  RandomAccessFile* file = files[kNumFiles - 1];
+
+  const int kNumReqs = 100;  // More than one io_uring submission
+  for (bool use_io_uring : {true, false}) {
+    SetUseIoUring(use_io_uring);
+    std::vector<std::string> scratch(kNumReqs);
+    std::vector<ReadRequest> reqs(kNumReqs);
+    for (int i = 0; i < kNumReqs; i++) {
+      scratch[i].resize(1000);
+      reqs[i].offset = i * 997;
+      reqs[i].n = 1 + (i * 31) % 1000;
+      reqs[i].scratch = &scratch[i][0];
+    }
+    reqs[kNumReqs - 2].offset = data.size() - 10;  // Short read at the end
+    reqs[kNumReqs - 1].offset = data.size() + 10;  // Past the end
+    file->MultiRead(reqs.data(), reqs.size());
+    for (int i = 0; i < kNumReqs; i++) {
+      ASSERT_LEVELDB_OK(reqs[i].status);
+      size_t offset = std::min<size_t>(reqs[i].offset, data.size());
+      ASSERT_EQ(data.substr(offset, reqs[i].n), reqs[i].result.ToString());
+    }
+  }
+  SetUseIoUring(true);
+
+  // Mapped files hint the batch and read it in place.
+  std::vector<ReadRequest> reqs(kNumReqs);
+  std::vector<std::string> scratch(kNumReqs);
+  for (int i = 0; i < kNumReqs; i++) {
+    scratch[i].resize(1000);
+    reqs[i].offset = i * 997;
+    reqs[i].n = 1 + (i * 31) % 1000;
+    reqs[i].scratch = &scratch[i][0];
+  }
+  files[0]->MultiRead(reqs.data(), reqs.size());
+  for (int i = 0; i < kNumReqs; i++) {
+    ASSERT_LEVELDB_OK(reqs[i].status);
+    ASSERT_EQ(data.substr(reqs[i].offset, reqs[i].n),
+              reqs[i].result.ToString());
+  }
+
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, DirectIO) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/direct_io.txt";
+
+  // Enough data to fill the write buffer more than once, appended in
+  // pieces that do not line up with the alignment of direct I/O.
+  std::string data;
+  for (int i = 0; data.size() < 3000000; i++) {
+    data.append(std::to_string(i));
+  }
+  WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(test_file, &writable_file));
+  const size_t kSyncAt = 1500000;
+  for (size_t pos = 0; pos < data.size();) {
+    size_t n = std::min<size_t>(data.size() - pos, 1 + (pos * 7) % 50000);
+    ASSERT_LEVELDB_OK(writable_file->Append(Slice(data.data() + pos, n)));
+    ASSERT_LEVELDB_OK(writable_file->Flush());
+    if (pos < kSyncAt && pos + n >= kSyncAt) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+      uint64_t file_size;
+      ASSERT_LEVELDB_OK(env_->GetFileSize(test_file, &file_size));
+      ASSERT_EQ(pos + n, file_size);
+    }
+    pos += n;
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, test_file, &contents));
+  ASSERT_EQ(data, contents);
+
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(test_file, &file));
+  char scratch[10000];
+  const uint64_t offsets[] = {0,      1,    4095, 4096, 123457,
+                              data.size() - 10, data.size() + 10};
+  for (uint64_t offset : offsets) {
+    Slice result;
+    ASSERT_LEVELDB_OK(file->Read(offset, sizeof(scratch), &result, scratch));
+    size_t start = std::min<size_t>(offset, data.size());
+    ASSERT_EQ(data.substr(start, sizeof(scratch)), result.ToString());
+  }
+  delete file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+TEST_F(EnvPosixTest, MmapRandomAccessFile) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string test_file = test_dir + "/mmap_random_access.txt";
+  std::string data;
+  for (int i = 0; data.size() < 100000; i++) {
+    data.append(std::to_string(i));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, data, test_file));
+
+  // Use up the mmap regions; the file is mapped all the same.
+  RandomAccessFile* files[kMMapLimit + 1] = {0};
+  for (int i = 0; i <= kMMapLimit; i++) {
+    ASSERT_LEVELDB_OK(env_->NewRandomAccessFile(test_file, &files[i]));
+  }
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env_->NewMmapRandomAccessFile(test_file, &file));
+
+  file->Hint(0, 0, RandomAccessFile::kRandom);
+  file->Hint(5000, 20000, RandomAccessFile::kSequential);
+  file->Hint(data.size() - 10, 100, RandomAccessFile::kWillNeed);
+  files[kMMapLimit]->Hint(0, 0, RandomAccessFile::kRandom);
+  char scratch[100];
+  Slice result;
+  ASSERT_LEVELDB_OK(file->Read(12345, sizeof(scratch), &result, scratch));
+  ASSERT_EQ(data.substr(12345, sizeof(scratch)), result.ToString());
+  ASSERT_NE(scratch, result.data());  // Read in place
+
+  delete file;
+  for (int i = 0; i <= kMMapLimit; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
+}
+
+struct PoolState {
+  port::Mutex mu;
+  port::CondVar cvar{&mu};
+  int running GUARDED_BY(mu) = 0;
+  int high_run GUARDED_BY(mu) = 0;
+  bool release GUARDED_BY(mu) = false;
+};
+
+// Wait until released, keeping PoolState::running up to date.
+static void BlockUntilReleased(void* arg) {
+  PoolState* state = reinterpret_cast<PoolState*>(arg);
+  MutexLock l(&state->mu);
+  state->running++;
+  state->cvar.SignalAll();
+  while (!state->release) {
+    state->cvar.Wait();
+  }
+  state->running--;
+  state->cvar.SignalAll();
+}
+
+static void CountHighRun(void* arg) {
+  PoolState* state = reinterpret_cast<PoolState*>(arg);
+  MutexLock l(&state->mu);
+  state->high_run++;
+  state->cvar.SignalAll();
+}
+
+TEST_F(EnvPosixTest, HighPriorityRunsWhileLowIsBusy) {
+  PoolState state;
+  env_->ScheduleWithPriority(&BlockUntilReleased, &state, Env::kLow);
+  env_->ScheduleWithPriority(&CountHighRun, &state, Env::kHigh);
+
+  MutexLock l(&state.mu);
+  while (state.high_run == 0) {
+    state.cvar.Wait();
+  }
+  EXPECT_EQ(1, state.running);
+  state.release = true;
+  state.cvar.SignalAll();
+  while (state.running > 0) {
+    state.cvar.Wait();
+  }
+}
+
+TEST_F(EnvPosixTest, SetBackgroundThreads) {
+  PoolState state;
+  env_->SetBackgroundThreads(2, Env::kLow);
+  env_->ScheduleWithPriority(&BlockUntilReleased, &state, Env::kLow);
+  env_->ScheduleWithPriority(&BlockUntilReleased, &state, Env::kLow);
+
+  {
+    // Both items run at the same time.
+    MutexLock l(&state.mu);
+    while (state.running < 2) {
+      state.cvar.Wait();
+    }
+    state.release = true;
+    state.cvar.SignalAll();
+    while (state.running > 0) {
+      state.cvar.Wait();
+    }
+  }
+  env_->SetBackgroundThreads(1, Env::kLow);
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -21,6 +21,10 @@ class EnvPosixTestHelper {
   // Set the maximum number of read-only files that will be mapped via mmap.
   // Must be called before creating an Env.
   static void SetReadOnlyMMapLimit(int limit);
+
+  // Set whether RandomAccessFile::MultiRead() may use io_uring.  When it
+  // may not, or the kernel lacks io_uring, reads go to a thread pool.
+  static void SetUseIoUring(bool use_io_uring);
 };
 
 }  // namespace leveldb
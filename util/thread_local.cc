@@ -0,0 +1,181 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <set>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+// The slots of one thread, indexed by ThreadLocalPtr id.  Only the owning
+// thread grows the array, and it does so while holding the registry
+// mutex, so other threads may walk it whenever they hold that mutex.
+struct ThreadData {
+  ThreadData() : entries(nullptr), size(0) {}
+  ~ThreadData() { delete[] entries; }
+
+  std::atomic<void*>* entries;
+  uint32_t size;
+};
+
+class Registry {
+ public:
+  Registry() : next_id_(0) {}
+
+  uint32_t NewId(ThreadLocalPtr::UnrefHandler handler) {
+    MutexLock l(&mu_);
+    uint32_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else {
+      id = next_id_++;
+      handlers_.push_back(nullptr);
+    }
+    handlers_[id] = handler;
+    return id;
+  }
+
+  // Run the handler on every thread's value for id, clear the slots and
+  // make id available for reuse.
+  void ReleaseId(uint32_t id) {
+    MutexLock l(&mu_);
+    for (ThreadData* t : threads_) {
+      if (id < t->size) {
+        void* ptr = t->entries[id].exchange(nullptr, std::memory_order_acq_rel);
+        if (ptr != nullptr && handlers_[id] != nullptr) {
+          (*handlers_[id])(ptr);
+        }
+      }
+    }
+    handlers_[id] = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  void Scrape(uint32_t id, std::vector<void*>* ptrs, void* replacement) {
+    MutexLock l(&mu_);
+    for (ThreadData* t : threads_) {
+      if (id < t->size) {
+        void* ptr = t->entries[id].exchange(replacement,
+                                            std::memory_order_acq_rel);
+        if (ptr != nullptr) {
+          ptrs->push_back(ptr);
+        }
+      }
+    }
+  }
+
+  void Register(ThreadData* t) {
+    MutexLock l(&mu_);
+    threads_.insert(t);
+  }
+
+  void OnThreadExit(ThreadData* t) {
+    MutexLock l(&mu_);
+    for (uint32_t id = 0; id < t->size; id++) {
+      void* ptr = t->entries[id].load(std::memory_order_acquire);
+      if (ptr != nullptr && handlers_[id] != nullptr) {
+        (*handlers_[id])(ptr);
+      }
+    }
+    threads_.erase(t);
+  }
+
+  // Grow the calling thread's array so that it has a slot for id.
+  void Grow(ThreadData* t, uint32_t id) {
+    MutexLock l(&mu_);
+    const uint32_t new_size = std::max<uint32_t>(id + 1, 2 * t->size);
+    std::atomic<void*>* entries = new std::atomic<void*>[new_size];
+    for (uint32_t i = 0; i < new_size; i++) {
+      void* ptr = nullptr;
+      if (i < t->size) {
+        ptr = t->entries[i].load(std::memory_order_relaxed);
+      }
+      entries[i].store(ptr, std::memory_order_relaxed);
+    }
+    delete[] t->entries;
+    t->entries = entries;
+    t->size = new_size;
+  }
+
+ private:
+  port::Mutex mu_;
+  uint32_t next_id_ GUARDED_BY(mu_);
+  std::vector<uint32_t> free_ids_ GUARDED_BY(mu_);
+  std::vector<ThreadLocalPtr::UnrefHandler> handlers_ GUARDED_BY(mu_);
+  std::set<ThreadData*> threads_ GUARDED_BY(mu_);
+};
+
+Registry* GetRegistry() {
+  static NoDestructor<Registry> registry;
+  return registry.get();
+}
+
+// Owns the calling thread's ThreadData and hands it back to the registry
+// when the thread exits.
+struct ThreadDataHolder {
+  ThreadDataHolder() : data(nullptr) {}
+  ~ThreadDataHolder() {
+    if (data != nullptr) {
+      GetRegistry()->OnThreadExit(data);
+      delete data;
+    }
+  }
+
+  ThreadData* data;
+};
+
+std::atomic<void*>* Slot(uint32_t id) {
+  static thread_local ThreadDataHolder holder;
+  ThreadData* t = holder.data;
+  if (t == nullptr) {
+    t = new ThreadData;
+    GetRegistry()->Register(t);
+    holder.data = t;
+  }
+  if (id >= t->size) {
+    GetRegistry()->Grow(t, id);
+  }
+  return &t->entries[id];
+}
+
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler)
+    : id_(GetRegistry()->NewId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() { GetRegistry()->ReleaseId(id_); }
+
+void* ThreadLocalPtr::Get() const {
+  return Slot(id_)->load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  Slot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return Slot(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return Slot(id_)->compare_exchange_strong(*expected, ptr,
+                                            std::memory_order_acq_rel);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  GetRegistry()->Scrape(id_, ptrs, replacement);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+// A pointer with one slot per thread.  Unlike a plain thread_local
+// variable, each ThreadLocalPtr is a separate object, and its owner can
+// reach into the slots of every thread with Scrape(): that is what lets a
+// DB keep a per-thread cache of reference-counted state and invalidate all
+// of the cached copies when the state changes.
+//
+// Get/Reset/Swap/CompareAndSwap only touch the calling thread's slot and
+// do not take any lock once the slot exists.  Scrape, thread exit and
+// construction/destruction of a ThreadLocalPtr synchronize on a global
+// mutex.
+class ThreadLocalPtr {
+ public:
+  // Called with the value left in a slot when its thread exits or when
+  // the ThreadLocalPtr is destroyed.  Runs while the global mutex is
+  // held, so it must not call back into any ThreadLocalPtr.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  ~ThreadLocalPtr();
+
+  // Return the calling thread's value.  Initially nullptr.
+  void* Get() const;
+
+  // Set the calling thread's value to ptr.
+  void Reset(void* ptr);
+
+  // Set the calling thread's value to ptr and return the previous value.
+  void* Swap(void* ptr);
+
+  // If the calling thread's value is *expected, replace it with ptr and
+  // return true.  Otherwise store the current value in *expected and
+  // return false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Replace the value of every thread with replacement and append the
+  // previous non-null values to *ptrs.
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
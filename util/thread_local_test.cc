@@ -0,0 +1,116 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+std::atomic<int> handled(0);
+
+void CountHandled(void* ptr) { handled.fetch_add(1); }
+
+}  // namespace
+
+TEST(ThreadLocalTest, SingleThread) {
+  ThreadLocalPtr tls;
+  int a, b;
+  ASSERT_EQ(nullptr, tls.Get());
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_FALSE(tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+TEST(ThreadLocalTest, SlotsAreIndependent) {
+  ThreadLocalPtr tls1;
+  ThreadLocalPtr tls2;
+  int a, b;
+  tls1.Reset(&a);
+  tls2.Reset(&b);
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(&b, tls2.Get());
+
+  std::thread other([&]() {
+    ASSERT_EQ(nullptr, tls1.Get());
+    tls1.Reset(&b);
+    ASSERT_EQ(&b, tls1.Get());
+  });
+  other.join();
+  ASSERT_EQ(&a, tls1.Get());
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  ThreadLocalPtr tls;
+  const int kThreads = 4;
+  int values[kThreads];
+  std::atomic<int> ready(0);
+  std::atomic<bool> scraped(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+      tls.Reset(&values[i]);
+      ready.fetch_add(1);
+      while (!scraped.load()) {
+        std::this_thread::yield();
+      }
+      ASSERT_EQ(nullptr, tls.Get());
+    });
+  }
+  while (ready.load() < kThreads) {
+    std::this_thread::yield();
+  }
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, nullptr);
+  scraped.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  ASSERT_EQ(static_cast<size_t>(kThreads), ptrs.size());
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_NE(ptrs.end(), std::find(ptrs.begin(), ptrs.end(), &values[i]));
+  }
+}
+
+TEST(ThreadLocalTest, HandlerRunsOnThreadExit) {
+  handled.store(0);
+  ThreadLocalPtr tls(&CountHandled);
+  int a;
+  std::thread t1([&]() { tls.Reset(&a); });
+  std::thread t2([&]() { tls.Get(); });  // Leaves nullptr behind
+  t1.join();
+  t2.join();
+  ASSERT_EQ(1, handled.load());
+}
+
+TEST(ThreadLocalTest, HandlerRunsOnDestruction) {
+  handled.store(0);
+  int a;
+  {
+    ThreadLocalPtr tls(&CountHandled);
+    tls.Reset(&a);
+  }
+  ASSERT_EQ(1, handled.load());
+
+  // A ThreadLocalPtr that reuses the id starts out empty.
+  ThreadLocalPtr tls;
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+}  // namespace leveldb